@@ -37,11 +37,14 @@ int getpid ();
 #endif
 
 
+/* Only prerequisites that don't need second expansion are entered into this
+   hash, and their names are always in the strcache: use the cached hash.  */
+
 static unsigned long
 dep_hash_1 (const void *key)
 {
   const struct dep *d = key;
-  return_STRING_HASH_1 (dep_name (d));
+  return strcache_get_hash (dep_name (d));
 }
 
 static unsigned long
@@ -62,17 +65,17 @@ dep_hash_cmp (const void *x, const void *y)
 static unsigned int
 escaped_name_length (const char *name)
 {
-  unsigned int len;
+  const char *start = name;
+  unsigned int spaces = 0;
   assert (name);
-  len = strlen (name);
   /* Add 1 for every space in the name (because the escape character is put back). */
   while (*name)
     {
       if (*name == ' ')
-        len++;
+        spaces++;
       name++;
     }
-  return len;
+  return (unsigned int) (name - start) + spaces;
 }
 
 static void
@@ -154,13 +157,14 @@ set_file_variables (struct file *file, const char *stem)
 #endif
         {
           name = file->name;
-          len = strlen (name);
+          len = strcache_get_len (name);
         }
 
       for (d = enter_file (strcache_add (".SUFFIXES"))->deps; d ; d = d->next)
         {
           const char *dn = dep_name (d);
-          size_t slen = strlen (dn);
+          size_t slen = d->need_2nd_expansion ? strlen (dn)
+                                              : strcache_get_len (dn);
           if (len > slen && strneq (dn, name + (len - slen), slen))
             {
               file->stem = stem = strcache_add_len (name, len - slen);
@@ -626,6 +630,9 @@ fatal_error_signal (int sig)
 
   remove_intermediates (1);
 
+  /* A make server starts over instead.  */
+  server_signal (sig);
+
 #ifdef SIGQUIT
   if (sig == SIGQUIT)
     /* We don't want to send ourselves SIGQUIT, because it will
@@ -407,7 +407,8 @@ install_default_implicit_rules (void)
       char *pct, *clm;
       if (!ISBLANK(item->line[0]) && (pct = strchr(item->line, '%')) != NULL && (clm = strchr(pct, ':')) != NULL && *(clm + 1) != '=')
         {
-          char target[128];
+          size_t len = clm - item->line;  /* target ends at the ':' */
+          char *target = alloca(len + 1);
           struct pspec p;
           int terminal = 0;
           clm++;                  /* skip ':' */
@@ -416,10 +417,10 @@ install_default_implicit_rules (void)
             terminal = 1;         /* double column -> this is a terminal rule */
             clm++;                /* skip second ':' */
             }
-          assert(clm - item->line < sizeof(target));
-          strncpy(target, item->line, clm - item->line);
-          target[clm - item->line] = '\0';
-          p.target = striptrailing(target); /* part before item->line, striptail() */
+          memcpy(target, item->line, len);
+          target[len] = '\0';
+          /* the rule keeps the target, so it must outlive this buffer */
+          p.target = strcache_add(striptrailing(target));
           p.dep = skipleading(clm);         /* part after item->line, skiplead */
           p.commands = collect_commandlines(item->next);
           install_pattern_rule (&p, terminal);
@@ -41,7 +41,10 @@ struct nameseq
    Each struct file's 'deps' points to a chain of these, through 'next'.
    'stem' is the stem for this dep line of static pattern rule or NULL.
    explicit is set when implicit rule search is performed and the prerequisite
-   does not contain %. When explicit is set the file is not intermediate.  */
+   does not contain %. When explicit is set the file is not intermediate.
+   depset_start marks the element where the part of a file's chain that is
+   its interned 'depset' begins (implicit rule search may add elements in
+   front of it).  */
 
 #define DEP(_t)                                 \
     NAMESEQ (_t);                               \
@@ -53,7 +56,8 @@ struct nameseq
     unsigned int staticpattern : 1;             \
     unsigned int need_2nd_expansion : 1;        \
     unsigned int ignore_automatic_vars : 1;     \
-    unsigned int wait_here : 1
+    unsigned int wait_here : 1;                 \
+    unsigned int depset_start : 1
 
 struct dep
   {
@@ -102,36 +106,47 @@ struct nameseq *ar_glob (const char *arname, const char *member_pattern, size_t
 
 #define dep_name(d)       ((d)->name ? (d)->name : (d)->file->name)
 
-#define alloc_seq_elt(_t) xcalloc (sizeof (_t))
+/* Elements of name sequences and dependency chains come from arenas: a
+   struct nameseq or struct dep from DEP_ARENA, a struct goaldep from
+   GOALDEP_ARENA.  Never free() them; use the functions below.  */
+extern struct arena dep_arena;
+extern struct arena goaldep_arena;
+
 void free_ns_chain (struct nameseq *n);
+void free_goaldep_chain (struct goaldep *g);
 
 #if defined(MAKE_MAINTAINER_MODE) && defined(__GNUC__) && !defined(__STRICT_ANSI__)
 /* Use inline to get real type-checking.  */
 #define SI static inline
-SI struct nameseq *alloc_ns (void)    { return alloc_seq_elt (struct nameseq); }
-SI struct dep *alloc_dep (void)       { return alloc_seq_elt (struct dep); }
-SI struct goaldep *alloc_goaldep (void) { return alloc_seq_elt (struct goaldep); }
+SI struct nameseq *alloc_ns (void)    { return arena_alloc (&dep_arena); }
+SI struct dep *alloc_dep (void)       { return arena_alloc (&dep_arena); }
+SI struct goaldep *alloc_goaldep (void) { return arena_alloc (&goaldep_arena); }
 
-SI void free_ns (struct nameseq *n)      { free (n); }
+SI void free_ns (struct nameseq *n)      { arena_free (&dep_arena, n); }
 SI void free_dep (struct dep *d)         { free_ns ((struct nameseq *)d); }
-SI void free_goaldep (struct goaldep *g) { free_dep ((struct dep *)g); }
+SI void free_goaldep (struct goaldep *g) { arena_free (&goaldep_arena, g); }
 SI void free_dep_chain (struct dep *d)   { free_ns_chain((struct nameseq *)d); }
-SI void free_goal_chain (struct goaldep *g) { free_dep_chain((struct dep *)g); }
+SI void free_goal_chain (struct goaldep *g) { free_goaldep_chain (g); }
 #else
-# define alloc_ns()          alloc_seq_elt (struct nameseq)
-# define alloc_dep()         alloc_seq_elt (struct dep)
-# define alloc_goaldep()     alloc_seq_elt (struct goaldep)
+# define alloc_ns()          ((struct nameseq *) arena_alloc (&dep_arena))
+# define alloc_dep()         ((struct dep *) arena_alloc (&dep_arena))
+# define alloc_goaldep()     ((struct goaldep *) arena_alloc (&goaldep_arena))
 
-# define free_ns(_n)         free (_n)
+# define free_ns(_n)         arena_free (&dep_arena, (_n))
 # define free_dep(_d)        free_ns (_d)
-# define free_goaldep(_g)    free_dep (_g)
+# define free_goaldep(_g)    arena_free (&goaldep_arena, (_g))
 
 # define free_dep_chain(_d)  free_ns_chain ((struct nameseq *)(_d))
-# define free_goal_chain(_g) free_ns_chain ((struct nameseq *)(_g))
+# define free_goal_chain(_g) free_goaldep_chain (_g)
 #endif
 
 struct dep *copy_dep_chain (const struct dep *d);
+struct dep *relocate_dep_chain (const struct dep *d, int copy);
 
 struct goaldep *read_all_makefiles (const char **makefiles);
 void eval_buffer (char *buffer, const floc *floc);
 enum update_status update_goal_chain (struct goaldep *goals);
+void prefetch_mtimes (struct goaldep *goals);
+void discard_prefetched_mtimes (void);
+void serve (struct goaldep *goals, struct goaldep *makefiles, int status,
+            const char *cwd) NORETURN;
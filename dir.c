@@ -18,6 +18,7 @@ this program.  If not, see <https://www.gnu.org/licenses/>.  */
 #include "hash.h"
 #include "filedef.h"
 #include "dep.h"
+#include "job.h"
 #include "debug.h"
 
 #ifdef  HAVE_DIRENT_H
@@ -60,6 +61,14 @@ const char *vmsify (const char *name, int type);
 # define FAKE_DIR_ENTRY(dp) (dp->d_ino = 1)
 #endif /* POSIX */
 
+#if defined(HAVE_GETDENTS64) || defined(HAVE_FSTATAT)
+# include <fcntl.h>
+#endif
+
+#if defined(HAVE_FSTATAT) && defined(O_DIRECTORY) && defined(O_CLOEXEC)
+# define USE_DIRECTORY_FDS 1
+#endif
+
 #ifdef __MSDOS__
 # include <ctype.h>
 # include <fcntl.h>
@@ -264,6 +273,13 @@ struct directory_contents
 #endif /* WINDOWS32 */
     struct hash_table dirfiles; /* Files in this directory.  */
     DIR *dirstream;             /* Stream reading this directory.  */
+    unsigned long *filter;      /* Bloom filter of DIRFILES, once all read.  */
+    unsigned long filter_mask;  /* Number of bits in FILTER, minus one.  */
+    struct hash_table impossibles; /* Names marked by file_impossible.  */
+    struct hash_table extensions; /* Extensions of DIRFILES, once asked.  */
+#ifdef MAKE_SERVER
+    struct dir_queries *queries; /* Names asked about; see server.c.  */
+#endif
   };
 
 static unsigned long
@@ -407,7 +423,9 @@ struct dirfile
   {
     const char *name;           /* Name of the file.  */
     size_t length;
-    short impossible;           /* This file is impossible.  */
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+    unsigned char type;         /* File type from the directory entry.  */
+#endif
   };
 
 static unsigned long
@@ -437,10 +455,328 @@ dirfile_hash_cmp (const void *xv, const void *yv)
 #define DIRFILE_BUCKETS 107
 #endif
 
+/* Names that have been ruled out by file_impossible are kept apart from the
+   files that really exist, as bare strcache pointers: a failed implicit rule
+   search can mark a great many of them, and they need neither a struct
+   dirfile of their own nor a place in the table that glob walks.  */
+
+static unsigned long
+impossible_hash_1 (const void *key)
+{
+  return_ISTRING_HASH_1 ((const char *) key);
+}
+
+static unsigned long
+impossible_hash_2 (const void *key)
+{
+  return_ISTRING_HASH_2 ((const char *) key);
+}
+
+static int
+impossible_hash_cmp (const void *x, const void *y)
+{
+  return_ISTRING_COMPARE ((const char *) x, (const char *) y);
+}
+
+#ifndef IMPOSSIBLE_BUCKETS
+#define IMPOSSIBLE_BUCKETS 31
+#endif
+
+/* The extensions of the names in a directory -- the text from the last
+   '.', or "" for names without one -- are collected the first time
+   dir_extension_p is asked about the directory, and kept like the
+   impossible names.  */
+
+unsigned long dir_extension_generation = 0;
+
+/* Add the extension of NAME to DC's.  Return nonzero if it is new.  */
+
+static int
+add_extension (struct directory_contents *dc, const char *name)
+{
+  const char *ext = strrchr (name, '.');
+  const char **slot;
+
+  if (ext == 0)
+    ext = "";
+  slot = (const char **) hash_find_slot (&dc->extensions, ext);
+  if (! HASH_VACANT (*slot))
+    return 0;
+
+  hash_insert_at (&dc->extensions, strcache_add (ext), slot);
+  return 1;
+}
+
+#ifdef MAKE_SERVER
+
+/* While make runs as a server, it remembers which names each directory has
+   been asked about, so that it can tell whether a change to the directory
+   could change any answer it has been given.  The names are kept like the
+   impossible ones.  Looking at the directory as a whole, as glob does, is
+   remembered too.  */
+
+struct dir_queries
+  {
+    struct hash_table parse;    /* Asked while reading the makefiles.  */
+    struct hash_table build;    /* Asked while updating the goals.  */
+    unsigned int listed:1;      /* Nonzero if glob has read the directory.  */
+  };
+
+/* Nonzero to record the questions asked: DIR_QUERY_PARSE while the
+   makefiles are read, DIR_QUERY_BUILD while goals are updated.  */
+
+int dir_record_queries = 0;
+
+static struct dir_queries *
+dir_queries (struct directory_contents *dc)
+{
+  if (dc->queries == 0)
+    dc->queries = xcalloc (sizeof (struct dir_queries));
+  return dc->queries;
+}
+
+static void
+record_dir_query (struct directory_contents *dc, const char *name)
+{
+  struct hash_table *ht = (dir_record_queries == DIR_QUERY_PARSE
+                           ? &dir_queries (dc)->parse
+                           : &dir_queries (dc)->build);
+  const char **slot;
+
+  if (ht->ht_vec == 0)
+    hash_init (ht, IMPOSSIBLE_BUCKETS,
+               impossible_hash_1, impossible_hash_2, impossible_hash_cmp);
+
+  slot = (const char **) hash_find_slot (ht, name);
+  if (HASH_VACANT (*slot))
+    hash_insert_at (ht, strcache_add (name), slot);
+}
+
+#endif /* MAKE_SERVER */
+
+/* Once a directory has been read in completely, a Bloom filter of its
+   entries answers most lookups of names that are not there without touching
+   the DIRFILES table.  Each name sets DIRFILTER_PROBES of the filter's bits,
+   and the filter has about DIRFILTER_BITS bits per entry; that lets about
+   one miss in thirty through to the table.  */
+
+#define DIRFILTER_BITS 8
+#define DIRFILTER_PROBES 3
+#define DIRFILTER_WORD_BITS (sizeof (unsigned long) * CHAR_BIT)
+
+static unsigned long
+dirfilter_hash (const char *name)
+{
+  const unsigned char *p = (const unsigned char *) name;
+  unsigned long h = 2166136261UL;
+
+  for (; *p != '\0'; ++p)
+    {
+#ifdef HAVE_CASE_INSENSITIVE_FS
+      h ^= isupper (*p) ? tolower (*p) : *p;
+#else
+      h ^= *p;
+#endif
+      h *= 16777619UL;
+    }
+
+  h ^= h >> 16;
+  h *= 0x45d9f3bUL;
+  h ^= h >> 16;
+  return h;
+}
+
+/* Set or test the bits for NAME in DC's filter.  The probes are spread by
+   double hashing from the one hash value.  */
+
+static void
+dirfilter_add (struct directory_contents *dc, const char *name)
+{
+  unsigned long h = dirfilter_hash (name);
+  unsigned long step = (h >> 11) | 1;
+  int i;
+
+  for (i = 0; i < DIRFILTER_PROBES; ++i, h += step)
+    {
+      unsigned long bit = h & dc->filter_mask;
+      dc->filter[bit / DIRFILTER_WORD_BITS]
+        |= 1UL << (bit % DIRFILTER_WORD_BITS);
+    }
+}
+
+static int
+dirfilter_maybe (const struct directory_contents *dc, const char *name)
+{
+  unsigned long h = dirfilter_hash (name);
+  unsigned long step = (h >> 11) | 1;
+  int i;
+
+  for (i = 0; i < DIRFILTER_PROBES; ++i, h += step)
+    {
+      unsigned long bit = h & dc->filter_mask;
+      if (!(dc->filter[bit / DIRFILTER_WORD_BITS]
+            & (1UL << (bit % DIRFILTER_WORD_BITS))))
+        return 0;
+    }
+
+  return 1;
+}
+
+/* Build the filter for DC, whose directory has just been read in.  */
+
+static void
+build_dirfilter (struct directory_contents *dc)
+{
+  struct dirfile **slot = (struct dirfile **) dc->dirfiles.ht_vec;
+  struct dirfile **end = slot + dc->dirfiles.ht_size;
+  unsigned long nbits = DIRFILTER_WORD_BITS;
+
+  while (nbits < dc->dirfiles.ht_fill * DIRFILTER_BITS)
+    nbits <<= 1;
+
+  free (dc->filter);
+  dc->filter = xcalloc (nbits / CHAR_BIT);
+  dc->filter_mask = nbits - 1;
+
+  for (; slot < end; ++slot)
+    if (! HASH_VACANT (*slot))
+      dirfilter_add (dc, (*slot)->name);
+}
+
 static int dir_contents_file_exists_p (struct directory_contents *dir,
                                        const char *filename);
 static struct directory *find_directory (const char *name);
 
+#ifdef HAVE_GETDENTS64
+
+/* Size of each getdents64() read.  */
+
+#define DIRENT_BUFFER_SIZE (64 * 1024)
+
+/* Read the whole directory NAME into DC with a few large getdents64()
+   calls, instead of one readdir() call per entry, and size DC's hash table
+   for the number of entries up front.  Return 0 if the directory could not
+   be read this way; the caller then falls back to opendir().  */
+
+static int
+load_directory (struct directory_contents *dc, const char *name)
+{
+  char *buf = 0;
+  size_t size = 0;
+  size_t used = 0;
+  size_t off;
+  unsigned long count = 0;
+  struct dirfile *df;
+  int fd;
+
+  EINTRLOOP (fd, open (name, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+  if (fd < 0)
+    return 0;
+
+  while (1)
+    {
+      ssize_t n;
+
+      if (size - used < DIRENT_BUFFER_SIZE)
+        {
+          size += size > DIRENT_BUFFER_SIZE ? size : DIRENT_BUFFER_SIZE;
+          buf = xrealloc (buf, size);
+        }
+
+      EINTRLOOP (n, getdents64 (fd, buf + used, size - used));
+      if (n < 0)
+        {
+          close (fd);
+          free (buf);
+          return 0;
+        }
+      if (n == 0)
+        break;
+      used += n;
+    }
+  close (fd);
+
+  for (off = 0; off < used; off += ((struct dirent64 *) (buf + off))->d_reclen)
+    if (((struct dirent64 *) (buf + off))->d_ino != 0)
+      ++count;
+
+  hash_init (&dc->dirfiles, count * 2 > DIRFILE_BUCKETS
+                            ? count * 2 : DIRFILE_BUCKETS,
+             dirfile_hash_1, dirfile_hash_2, dirfile_hash_cmp);
+
+  df = count ? xmalloc (count * sizeof (struct dirfile)) : 0;
+  for (off = 0; off < used; off += ((struct dirent64 *) (buf + off))->d_reclen)
+    {
+      const struct dirent64 *d = (const struct dirent64 *) (buf + off);
+
+      if (d->d_ino == 0)
+        continue;
+
+      df->length = strlen (d->d_name);
+      df->name = strcache_add_len (d->d_name, df->length);
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+      df->type = d->d_type;
+#endif
+      hash_insert (&dc->dirfiles, df);
+      ++df;
+    }
+
+  free (buf);
+  dc->dirstream = 0;
+  build_dirfilter (dc);
+  return 1;
+}
+
+#endif /* HAVE_GETDENTS64 */
+
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+
+/* Return nonzero if the entry for NAME in its parent directory, which has
+   already been read in completely, says that NAME is not a directory.  Such
+   a NAME need not be stat()ed to find out that it cannot be opened as one.
+   Symlinks and entries of unknown type do not count.  */
+
+static int
+known_non_directory (const char *name)
+{
+  const char *base = strrchr (name, '/');
+  struct directory dir_key;
+  struct directory *parent;
+  struct dirfile dirfile_key;
+  struct dirfile *df;
+
+  if (base == 0)
+    {
+      dir_key.name = ".";
+      base = name;
+    }
+  else if (base == name || base[1] == '\0')
+    return 0;
+  else
+    {
+      char *p = alloca (base - name + 1);
+      memcpy (p, name, base - name);
+      p[base - name] = '\0';
+      dir_key.name = p;
+      ++base;
+    }
+
+  parent = hash_find_item (&directories, &dir_key);
+  if (parent == 0 || parent->contents == 0
+      || parent->contents->dirfiles.ht_vec == 0
+      || parent->contents->dirstream != 0)
+    return 0;
+
+  dirfile_key.name = base;
+  dirfile_key.length = strlen (base);
+  df = hash_find_item (&parent->contents->dirfiles, &dirfile_key);
+
+  return (df != 0 && df->type != DT_UNKNOWN
+          && df->type != DT_DIR && df->type != DT_LNK);
+}
+
+#endif /* HAVE_STRUCT_DIRENT_D_TYPE */
+
 /* Find the directory named NAME and return its 'struct directory'.  */
 
 static struct directory *
@@ -472,6 +808,7 @@ find_directory (const char *name)
 #else
       dir->name = strcache_add_len (name, len);
 #endif
+      dir->contents = 0;
       hash_insert_at (&directories, dir, dir_slot);
 
       /* The directory is not in the name hash table.
@@ -495,7 +832,12 @@ find_directory (const char *name)
         r = stat (tem, &st);
       }
 #else
-      EINTRLOOP (r, stat (name, &st));
+# ifdef HAVE_STRUCT_DIRENT_D_TYPE
+      if (known_non_directory (name))
+        r = -1;
+      else
+# endif
+        EINTRLOOP (r, stat (name, &st));
 #endif
 
       if (r < 0)
@@ -573,22 +915,33 @@ find_directory (const char *name)
               dc->ino = st.st_ino;
 # endif
 #endif /* WINDOWS32 */
+              dc->filter = 0;
+              dc->impossibles.ht_vec = 0;
+              dc->extensions.ht_vec = 0;
+#ifdef MAKE_SERVER
+              dc->queries = 0;
+#endif
               hash_insert_at (&directory_contents, dc, dc_slot);
-              ENULLLOOP (dc->dirstream, opendir (name));
-              if (dc->dirstream == 0)
-                /* Couldn't open the directory.  Mark this by setting the
-                   'files' member to a nil pointer.  */
-                dc->dirfiles.ht_vec = 0;
-              else
+#ifdef HAVE_GETDENTS64
+              if (!load_directory (dc, name))
+#endif
                 {
-                  hash_init (&dc->dirfiles, DIRFILE_BUCKETS,
-                             dirfile_hash_1, dirfile_hash_2, dirfile_hash_cmp);
-                  /* Keep track of how many directories are open.  */
-                  ++open_directories;
-                  if (open_directories == MAX_OPEN_DIRECTORIES)
-                    /* We have too many directories open already.
-                       Read the entire directory and then close it.  */
-                    dir_contents_file_exists_p (dc, 0);
+                  ENULLLOOP (dc->dirstream, opendir (name));
+                  if (dc->dirstream == 0)
+                    /* Couldn't open the directory.  Mark this by setting
+                       the 'files' member to a nil pointer.  */
+                    dc->dirfiles.ht_vec = 0;
+                  else
+                    {
+                      hash_init (&dc->dirfiles, DIRFILE_BUCKETS, dirfile_hash_1,
+                                 dirfile_hash_2, dirfile_hash_cmp);
+                      /* Keep track of how many directories are open.  */
+                      ++open_directories;
+                      if (open_directories == MAX_OPEN_DIRECTORIES)
+                        /* We have too many directories open already.
+                           Read the entire directory and then close it.  */
+                        dir_contents_file_exists_p (dc, 0);
+                    }
                 }
             }
 
@@ -629,6 +982,10 @@ dir_contents_file_exists_p (struct directory_contents *dir,
 #ifdef __EMX__
   if (filename != 0)
     _fnlwr (filename); /* lower case for FAT drives */
+#endif
+#ifdef MAKE_SERVER
+  if (dir_record_queries && filename != 0 && *filename != '\0')
+    record_dir_query (dir, filename);
 #endif
   if (filename != 0)
     {
@@ -639,11 +996,16 @@ dir_contents_file_exists_p (struct directory_contents *dir,
           /* Checking if the directory exists.  */
           return 1;
         }
-      dirfile_key.name = filename;
-      dirfile_key.length = strlen (filename);
-      df = hash_find_item (&dir->dirfiles, &dirfile_key);
-      if (df)
-        return !df->impossible;
+      /* If the directory has been read in, the filter rules out most
+         names that are not in it.  */
+      if (dir->filter == 0 || dirfilter_maybe (dir, filename))
+        {
+          dirfile_key.name = filename;
+          dirfile_key.length = strlen (filename);
+          df = hash_find_item (&dir->dirfiles, &dirfile_key);
+          if (df)
+            return 1;
+        }
     }
 
   /* The file was not found in the hashed list.
@@ -679,6 +1041,10 @@ dir_contents_file_exists_p (struct directory_contents *dir,
           dir->dirstream = opendir (dir->path_key);
           if (!dir->dirstream)
             return 0;
+
+          /* New entries may turn up; the filter is rebuilt afterwards.  */
+          free (dir->filter);
+          dir->filter = 0;
         }
       else
 #endif
@@ -737,8 +1103,9 @@ dir_contents_file_exists_p (struct directory_contents *dir,
           df->type = d->d_type;
 #endif
           df->length = len;
-          df->impossible = 0;
           hash_insert_at (&dir->dirfiles, df, dirfile_slot);
+          if (dir->extensions.ht_vec != 0 && add_extension (dir, df->name))
+            ++dir_extension_generation;
         }
       /* Check if the name matches the one we're searching for.  */
       if (filename != 0 && patheq (d->d_name, filename))
@@ -752,6 +1119,7 @@ dir_contents_file_exists_p (struct directory_contents *dir,
       --open_directories;
       closedir (dir->dirstream);
       dir->dirstream = 0;
+      build_dirfilter (dir);
     }
   return 0;
 }
@@ -776,6 +1144,87 @@ dir_file_exists_p (const char *dirname, const char *filename)
                                      filename);
 }
 
+/* Return 1 if the name FILENAME is in directory DIRNAME, 0 if it is not,
+   or -1 if the directory cannot be read.  FILENAME must contain no
+   slashes.  */
+
+int
+dir_file_listed (const char *dirname, const char *filename)
+{
+  struct directory_contents *dc = find_directory (dirname)->contents;
+
+  if (dc == 0 || dc->dirfiles.ht_vec == 0)
+    return -1;
+  return dir_contents_file_exists_p (dc, filename);
+}
+
+/* Bumped whenever a name is added to a directory that had been read in
+   completely, which can invalidate what dir_map_files() reported.  */
+
+unsigned long dir_generation = 0;
+
+/* Read in the whole of directory DIRNAME, and call FN with the name of
+   each file in it and ARG.  Return zero if the directory cannot be
+   read.  */
+
+int
+dir_map_files (const char *dirname, void (*fn) (const char *, void *),
+               void *arg)
+{
+  struct directory_contents *dc = find_directory (dirname)->contents;
+  struct dirfile **slot;
+  struct dirfile **end;
+
+  if (dc == 0 || dc->dirfiles.ht_vec == 0)
+    return 0;
+
+  /* A null name makes it read the rest of the directory.  */
+  if (dc->dirstream != 0)
+    dir_contents_file_exists_p (dc, 0);
+
+  slot = (struct dirfile **) dc->dirfiles.ht_vec;
+  end = slot + dc->dirfiles.ht_size;
+  for (; slot < end; ++slot)
+    if (! HASH_VACANT (*slot))
+      fn ((*slot)->name, arg);
+
+  return 1;
+}
+
+/* Return nonzero if directory DIRNAME may have a file whose name ends in
+   the extension EXT, as add_extension takes it.  Zero means that it has
+   been read in completely, or cannot be read, and there is none; as far as
+   file_exists_p is concerned, no such file exists.  */
+
+int
+dir_extension_p (const char *dirname, const char *ext)
+{
+  struct directory_contents *dc = find_directory (dirname)->contents;
+
+  if (dc == 0 || dc->dirfiles.ht_vec == 0)
+    return 0;
+
+  if (dc->extensions.ht_vec == 0)
+    {
+      struct dirfile **slot;
+      struct dirfile **end;
+
+      /* A null name makes it read the rest of the directory.  */
+      if (dc->dirstream != 0)
+        dir_contents_file_exists_p (dc, 0);
+
+      hash_init (&dc->extensions, IMPOSSIBLE_BUCKETS,
+                 impossible_hash_1, impossible_hash_2, impossible_hash_cmp);
+      slot = (struct dirfile **) dc->dirfiles.ht_vec;
+      end = slot + dc->dirfiles.ht_size;
+      for (; slot < end; ++slot)
+        if (! HASH_VACANT (*slot))
+          add_extension (dc, (*slot)->name);
+    }
+
+  return hash_find_item (&dc->extensions, ext) != 0;
+}
+
 /* Return 1 if the file named NAME exists.  */
 
 int
@@ -862,7 +1311,7 @@ file_impossible (const char *filename)
   const char *dirend;
   const char *p = filename;
   struct directory *dir;
-  struct dirfile *new;
+  const char **slot;
 
   dirend = strrchr (p, '/');
 #ifdef VMS
@@ -935,24 +1384,19 @@ file_impossible (const char *filename)
        structure for it, but leave it out of the contents hash table.  */
     dir->contents = xcalloc (sizeof (struct directory_contents));
 
-  if (dir->contents->dirfiles.ht_vec == 0)
-    {
-      hash_init (&dir->contents->dirfiles, DIRFILE_BUCKETS,
-                 dirfile_hash_1, dirfile_hash_2, dirfile_hash_cmp);
-    }
-
-  /* Make a new entry and put it in the table.  */
+  if (dir->contents->impossibles.ht_vec == 0)
+    hash_init (&dir->contents->impossibles, IMPOSSIBLE_BUCKETS,
+               impossible_hash_1, impossible_hash_2, impossible_hash_cmp);
 
-  new = xmalloc (sizeof (struct dirfile));
-  new->length = strlen (filename);
 #if defined(HAVE_CASE_INSENSITIVE_FS) && defined(VMS)
   /* todo: Why is this only needed on VMS? */
-  new->name = strcache_add_len (downcase (filename), new->length);
-#else
-  new->name = strcache_add_len (filename, new->length);
+  filename = downcase (filename);
 #endif
-  new->impossible = 1;
-  hash_insert (&dir->contents->dirfiles, new);
+  slot = (const char **) hash_find_slot (&dir->contents->impossibles,
+                                         filename);
+  if (HASH_VACANT (*slot))
+    hash_insert_at (&dir->contents->impossibles, strcache_add (filename),
+                    slot);
 }
 
 /* Return nonzero if FILENAME has been marked impossible.  */
@@ -962,8 +1406,6 @@ file_impossible_p (const char *filename)
 {
   const char *dirend;
   struct directory_contents *dir;
-  struct dirfile *dirfile;
-  struct dirfile dirfile_key;
 #ifdef VMS
   int want_vmsify = 0;
 #endif
@@ -1028,8 +1470,8 @@ file_impossible_p (const char *filename)
 #endif
     }
 
-  if (dir == 0 || dir->dirfiles.ht_vec == 0)
-    /* There are no files entered for this directory.  */
+  if (dir == 0 || dir->impossibles.ht_vec == 0)
+    /* No file in this directory has been marked impossible.  */
     return 0;
 
 #ifdef __MSDOS__
@@ -1043,13 +1485,7 @@ file_impossible_p (const char *filename)
     filename = vmsify (filename, 1);
 #endif
 
-  dirfile_key.name = filename;
-  dirfile_key.length = strlen (filename);
-  dirfile = hash_find_item (&dir->dirfiles, &dirfile_key);
-  if (dirfile)
-    return dirfile->impossible;
-
-  return 0;
+  return hash_find_item (&dir->impossibles, filename) != 0;
 }
 
 /* Return the already allocated name in the
@@ -1061,6 +1497,183 @@ dir_name (const char *dir)
   return find_directory (dir)->name;
 }
 
+#ifdef MAKE_SERVER
+
+/* Call FN for each directory that has been looked at, with the name it was
+   looked at by, nonzero if it could be read and ARG.  */
+
+void
+map_directories (void (*fn) (const char *, int, void *), void *arg)
+{
+  struct directory **slot = (struct directory **) directories.ht_vec;
+  struct directory **end = slot + directories.ht_size;
+
+  for (; slot < end; ++slot)
+    if (! HASH_VACANT (*slot))
+      fn ((*slot)->name, ((*slot)->contents != 0
+                          && (*slot)->contents->dirfiles.ht_vec != 0), arg);
+}
+
+/* Return the contents of the directory DIRNAME, if it has been read in
+   completely, else null.  Unlike find_directory(), never look at the disk.  */
+
+static struct directory_contents *
+cached_directory (const char *dirname)
+{
+  struct directory dir_key;
+  struct directory *dir;
+
+  dir_key.name = dirname;
+  dir = hash_find_item (&directories, &dir_key);
+  if (dir == 0 || dir->contents == 0 || dir->contents->dirfiles.ht_vec == 0
+      || dir->contents->dirstream != 0)
+    return 0;
+
+  return dir->contents;
+}
+
+/* Return 1 if the cache of DIRNAME has FILENAME in it, 0 if it does not,
+   or -1 if DIRNAME has not been read in.  */
+
+int
+dir_file_known (const char *dirname, const char *filename)
+{
+  struct directory_contents *dc = cached_directory (dirname);
+  struct dirfile dirfile_key;
+
+  if (dc == 0)
+    return -1;
+
+  dirfile_key.name = filename;
+  dirfile_key.length = strlen (filename);
+  return hash_find_item (&dc->dirfiles, &dirfile_key) != 0;
+}
+
+/* Return how much make has relied on what it knows about FILENAME in
+   DIRNAME: 0 not at all, DIR_QUERY_BUILD if it was looked up or found
+   impossible while updating goals, or DIR_QUERY_PARSE if it was looked up
+   while reading the makefiles or the whole directory was globbed.  */
+
+int
+dir_file_queried (const char *dirname, const char *filename)
+{
+  struct directory_contents *dc = cached_directory (dirname);
+  struct dir_queries *dq;
+
+  if (dc == 0)
+    return 0;
+
+  dq = dc->queries;
+  if (dq != 0 && (dq->listed
+                  || (dq->parse.ht_vec != 0
+                      && hash_find_item (&dq->parse, filename) != 0)))
+    return DIR_QUERY_PARSE;
+
+  if ((dq != 0 && dq->build.ht_vec != 0
+       && hash_find_item (&dq->build, filename) != 0)
+      || (dc->impossibles.ht_vec != 0
+          && hash_find_item (&dc->impossibles, filename) != 0))
+    return DIR_QUERY_BUILD;
+
+  return 0;
+}
+
+/* Bring the cache of DIRNAME up to date after FILENAME was created in it,
+   if EXISTS is nonzero, or removed from it.  */
+
+void
+dir_file_changed (const char *dirname, const char *filename, int exists)
+{
+  struct directory_contents *dc = cached_directory (dirname);
+  struct dirfile dirfile_key;
+  struct dirfile **slot;
+
+  if (dc == 0)
+    return;
+
+  dirfile_key.name = filename;
+  dirfile_key.length = strlen (filename);
+  slot = (struct dirfile **) hash_find_slot (&dc->dirfiles, &dirfile_key);
+
+  if (!exists)
+    {
+      if (! HASH_VACANT (*slot))
+        hash_delete_at (&dc->dirfiles, slot);
+      return;
+    }
+
+  if (HASH_VACANT (*slot))
+    {
+      struct dirfile *df = xmalloc (sizeof (struct dirfile));
+      df->length = dirfile_key.length;
+      df->name = strcache_add_len (filename, df->length);
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+      df->type = DT_UNKNOWN;
+#endif
+      hash_insert_at (&dc->dirfiles, df, slot);
+      if (dc->filter != 0)
+        dirfilter_add (dc, df->name);
+      if (dc->extensions.ht_vec != 0 && add_extension (dc, df->name))
+        ++dir_extension_generation;
+      ++dir_generation;
+    }
+
+  if (dc->impossibles.ht_vec != 0)
+    hash_delete (&dc->impossibles, filename);
+}
+
+/* Return nonzero if the directory DIRNAME no longer holds the names that
+   were read in from it, or has come into being since it was looked for.  */
+
+int
+dir_contents_changed (const char *dirname)
+{
+  struct directory dir_key;
+  struct directory *dir;
+  struct directory_contents *dc;
+  unsigned long count = 0;
+  int changed = 0;
+  struct dirent *d;
+  DIR *stream;
+  struct stat st;
+
+  dir_key.name = dirname;
+  dir = hash_find_item (&directories, &dir_key);
+  if (dir == 0)
+    return 0;
+
+  dc = dir->contents;
+  if (dc == 0 || dc->dirfiles.ht_vec == 0)
+    return stat (dirname, &st) == 0;
+  if (dc->dirstream != 0)
+    return 0;
+
+  ENULLLOOP (stream, opendir (dirname));
+  if (stream == 0)
+    return 1;
+
+  while (!changed)
+    {
+      struct dirfile dirfile_key;
+
+      ENULLLOOP (d, readdir (stream));
+      if (d == 0)
+        break;
+      if (!REAL_DIR_ENTRY (d))
+        continue;
+
+      dirfile_key.name = d->d_name;
+      dirfile_key.length = NAMLEN (d);
+      changed = hash_find_item (&dc->dirfiles, &dirfile_key) == 0;
+      ++count;
+    }
+  closedir (stream);
+
+  return changed || count != dc->dirfiles.ht_fill;
+}
+
+#endif /* MAKE_SERVER */
+
 /* Print the data base of directories.  */
 
 void
@@ -1084,7 +1697,8 @@ print_dir_data_base (void)
         {
           if (dir->contents == 0)
             printf (_("# %s: could not be stat'd.\n"), dir->name);
-          else if (dir->contents->dirfiles.ht_vec == 0)
+          else if (dir->contents->dirfiles.ht_vec == 0
+                   && dir->contents->impossibles.ht_vec == 0)
             {
 #ifdef WINDOWS32
               printf (_("# %s (key %s, mtime %" PRIu64 "): could not be opened.\n"),
@@ -1107,22 +1721,11 @@ print_dir_data_base (void)
             {
               unsigned int f = 0;
               unsigned int im = 0;
-              struct dirfile **files_slot;
-              struct dirfile **files_end;
 
-              files_slot = (struct dirfile **) dir->contents->dirfiles.ht_vec;
-              files_end = files_slot + dir->contents->dirfiles.ht_size;
-              for ( ; files_slot < files_end; files_slot++)
-                {
-                  struct dirfile *df = *files_slot;
-                  if (! HASH_VACANT (df))
-                    {
-                      if (df->impossible)
-                        ++im;
-                      else
-                        ++f;
-                    }
-                }
+              if (dir->contents->dirfiles.ht_vec != 0)
+                f = dir->contents->dirfiles.ht_fill;
+              if (dir->contents->impossibles.ht_vec != 0)
+                im = dir->contents->impossibles.ht_fill;
 #ifdef WINDOWS32
               printf (_("# %s (key %s, mtime %" PRIu64 "): "),
                       dir->name, dir->contents->path_key,
@@ -1201,6 +1804,11 @@ open_dirstream (const char *directory)
 
   dir_contents_file_exists_p (dir->contents, 0);
 
+#ifdef MAKE_SERVER
+  if (dir_record_queries)
+    dir_queries (dir->contents)->listed = 1;
+#endif
+
   new = xmalloc (sizeof (struct dirstream));
   new->contents = dir->contents;
   new->dirfile_slot = (struct dirfile **) new->contents->dirfiles.ht_vec;
@@ -1221,7 +1829,7 @@ read_dirstream (__ptr_t stream)
   while (ds->dirfile_slot < dirfile_end)
     {
       struct dirfile *df = *ds->dirfile_slot++;
-      if (! HASH_VACANT (df) && !df->impossible)
+      if (! HASH_VACANT (df))
         {
           /* The glob interface wants a 'struct dirent', so mock one up.  */
           struct dirent *d;
@@ -1268,13 +1876,14 @@ read_dirstream (__ptr_t stream)
 #  ifndef HAVE_SYS_STAT_H
 int stat (const char *path, struct stat *sbuf);
 #  endif
+#  define local_stat dir_stat
 # else
     /* We are done with the fake stat.  Go back to the real stat */
 #   ifdef stat
 #     undef stat
 #   endif
+#  define local_stat stat
 # endif
-# define local_stat stat
 #else
 static int
 local_stat (const char *path, struct stat *buf)
@@ -1298,11 +1907,174 @@ local_stat (const char *path, struct stat *buf)
     }
 #endif
 
-  EINTRLOOP (e, stat (path, buf));
+  EINTRLOOP (e, dir_stat (path, buf));
   return e;
 }
 #endif
 
+/* Descriptors of the directories that files are stat()ed in.  Looking up
+   a file relative to its directory saves the kernel from resolving the
+   directory part of the name again, component by component, for every file
+   in it.  The table is keyed by the directory part of the names as given,
+   and is separate from the directory contents cache above, so that getting
+   a descriptor never means reading the directory.
+
+   A descriptor keeps referring to the same directory even after that is
+   removed and made again under the same name, so the descriptors are only
+   trusted until make next runs a command: close_directory_fds() is called
+   before that, and they are opened again as they are needed.  While any
+   command is still running (under -j, make goes on looking at other files
+   meanwhile), no descriptor is opened or used at all.  */
+
+#ifdef USE_DIRECTORY_FDS
+
+#ifndef O_PATH
+# define O_PATH O_RDONLY
+#endif
+
+/* Never hold more than this many directory descriptors.  */
+
+#define MAX_DIRECTORY_FDS 256
+
+/* Names with fewer slashes than this are left to stat(); there is
+   little of the path to save.  */
+
+#define DIRECTORY_FD_MIN_DEPTH 2
+
+struct directory_fd
+  {
+    const char *name;           /* Directory part of the file names.  */
+    int fd;                     /* Its descriptor, or -1 if none.  */
+  };
+
+static unsigned long
+directory_fd_hash_1 (const void *key)
+{
+  return_ISTRING_HASH_1 (((const struct directory_fd *) key)->name);
+}
+
+static unsigned long
+directory_fd_hash_2 (const void *key)
+{
+  return_ISTRING_HASH_2 (((const struct directory_fd *) key)->name);
+}
+
+static int
+directory_fd_hash_cmp (const void *x, const void *y)
+{
+  return_ISTRING_COMPARE (((const struct directory_fd *) x)->name,
+                          ((const struct directory_fd *) y)->name);
+}
+
+static struct hash_table directory_fds;
+static unsigned int open_directory_fds = 0;
+
+#endif /* USE_DIRECTORY_FDS */
+
+/* Return a descriptor for the directory that file NAME is in, opening it if
+   need be, and point *BASE at the part of NAME to look up relative to it.
+   If there is none to be had, point *BASE at NAME itself; the result is
+   then AT_FDCWD, or -1 where that is not supported.  */
+
+int
+dir_fd (const char *name, const char **base)
+{
+#ifdef USE_DIRECTORY_FDS
+  const char *slash = strrchr (name, '/');
+  struct directory_fd key;
+  struct directory_fd **slot;
+  struct directory_fd *dfd;
+  const char *p;
+  char *dirname;
+  int depth = 0;
+
+  *base = name;
+  if (slash == 0 || slash == name || slash[1] == '\0' || children != 0)
+    return AT_FDCWD;
+
+  for (p = name; p <= slash; ++p)
+    if (*p == '/')
+      ++depth;
+  if (depth < DIRECTORY_FD_MIN_DEPTH)
+    return AT_FDCWD;
+
+  dirname = alloca (slash - name + 1);
+  memcpy (dirname, name, slash - name);
+  dirname[slash - name] = '\0';
+  key.name = dirname;
+
+  if (directory_fds.ht_vec == 0)
+    hash_init (&directory_fds, DIRECTORY_BUCKETS, directory_fd_hash_1,
+               directory_fd_hash_2, directory_fd_hash_cmp);
+
+  slot = (struct directory_fd **) hash_find_slot (&directory_fds, &key);
+  dfd = *slot;
+  if (HASH_VACANT (dfd))
+    {
+      if (open_directory_fds == MAX_DIRECTORY_FDS)
+        return AT_FDCWD;
+
+      dfd = xmalloc (sizeof (struct directory_fd));
+      dfd->name = strcache_add_len (name, slash - name);
+      EINTRLOOP (dfd->fd, open (dfd->name, O_PATH | O_DIRECTORY | O_CLOEXEC));
+      if (dfd->fd >= 0)
+        ++open_directory_fds;
+      hash_insert_at (&directory_fds, dfd, slot);
+    }
+
+  if (dfd->fd < 0)
+    return AT_FDCWD;
+
+  *base = slash + 1;
+  return dfd->fd;
+#else
+  *base = name;
+  return -1;
+#endif
+}
+
+/* Like stat(), but look NAME up relative to its directory's descriptor.  */
+
+int
+dir_stat (const char *name, struct stat *st)
+{
+#ifdef USE_DIRECTORY_FDS
+  const char *base;
+  int fd = dir_fd (name, &base);
+
+  return fstatat (fd, base, st, 0);
+#else
+  return stat (name, st);
+#endif
+}
+
+#ifdef USE_DIRECTORY_FDS
+static void
+close_directory_fd (const void *item)
+{
+  struct directory_fd *dfd = (struct directory_fd *) item;
+
+  if (dfd->fd >= 0)
+    close (dfd->fd);
+  free (dfd);
+}
+#endif
+
+/* Close all directory descriptors; the directories may change now.  */
+
+void
+close_directory_fds (void)
+{
+#ifdef USE_DIRECTORY_FDS
+  if (directory_fds.ht_vec == 0)
+    return;
+
+  hash_map (&directory_fds, close_directory_fd);
+  hash_free (&directory_fds, 0);
+  open_directory_fds = 0;
+#endif
+}
+
 void
 dir_setup_glob (glob_t *gl)
 {
@@ -36,6 +36,9 @@ this program.  If not, see <https://www.gnu.org/licenses/>.  */
    only work on files which have not yet been snapped. */
 int snapped_deps = 0;
 
+/* Number of times rehash_file() has given a file a new name.  */
+unsigned int rehashed_files = 0;
+
 /* Hash table of files the makefile knows how to make.  */
 
 static unsigned long
@@ -59,9 +62,109 @@ file_hash_cmp (const void *x, const void *y)
 
 static struct hash_table files;
 
+/* All file records come from this arena; they are never freed.  */
+static struct arena file_arena = ARENA_INIT ("file", struct file);
+
 /* Whether or not .SECONDARY with no prerequisites was given.  */
 static int all_secondary = 0;
 
+/* The directories and extensions of the names in FILES, as strings of
+   the directory part of a name, up to and including its last slash, and
+   the text from the last '.' after that.  They are collected the first
+   time file_extension_p is called.  */
+
+static unsigned long
+extension_hash_1 (const void *key)
+{
+  return_ISTRING_HASH_1 ((const char *) key);
+}
+
+static unsigned long
+extension_hash_2 (const void *key)
+{
+  return_ISTRING_HASH_2 ((const char *) key);
+}
+
+static int
+extension_hash_cmp (const void *x, const void *y)
+{
+  return_ISTRING_COMPARE ((const char *) x, (const char *) y);
+}
+
+static struct hash_table file_extensions;
+
+/* Bumped whenever a file with a new directory and extension is entered.  */
+unsigned long file_extension_generation = 0;
+
+/* Add the directory and extension of NAME.  Return nonzero if new.  */
+
+static int
+add_file_extension (const char *name)
+{
+  const char *base = strrchr (name, '/');
+  const char *ext;
+  size_t dirlen;
+  size_t extlen;
+  char *key;
+  const char **slot;
+
+  base = base != 0 ? base + 1 : name;
+  ext = strrchr (base, '.');
+  if (ext == 0)
+    ext = "";
+  dirlen = base - name;
+  extlen = strlen (ext);
+
+  key = alloca (dirlen + extlen + 1);
+  memcpy (key, name, dirlen);
+  memcpy (key + dirlen, ext, extlen + 1);
+
+  slot = (const char **) hash_find_slot (&file_extensions, key);
+  if (! HASH_VACANT (*slot))
+    return 0;
+
+  hash_insert_at (&file_extensions, strcache_add (key), slot);
+  return 1;
+}
+
+static void
+add_file_item_extension (const void *item)
+{
+  add_file_extension (((const struct file *) item)->hname);
+}
+
+/* NAME has just been entered in the data base.  */
+
+static void
+note_new_file (const char *name)
+{
+  vpath_note_file (name);
+  if (file_extensions.ht_vec != 0 && add_file_extension (name))
+    ++file_extension_generation;
+}
+
+/* Return nonzero if the data base has a file in directory DIR, DIRLEN
+   bytes long and ending in a slash unless it is empty, whose name ends in
+   the extension EXT: the text from its last '.', or "" if it has none.  */
+
+int
+file_extension_p (const char *dir, size_t dirlen, const char *ext)
+{
+  size_t extlen = strlen (ext);
+  char *key = alloca (dirlen + extlen + 1);
+
+  if (file_extensions.ht_vec == 0)
+    {
+      hash_init (&file_extensions, 1021, extension_hash_1, extension_hash_2,
+                 extension_hash_cmp);
+      hash_map (&files, add_file_item_extension);
+    }
+
+  memcpy (key, dir, dirlen);
+  memcpy (key + dirlen, ext, extlen + 1);
+  return hash_find_item (&file_extensions, key) != 0;
+}
+
 /** lookup_file(): given a name, return the `struct file *` for that name,
  *  or nil if there is none. Accesses the hash table of all file records.
  */
@@ -188,7 +291,7 @@ enter_file (const char *name)
       return f;
     }
 
-  new = xcalloc (sizeof (struct file));
+  new = arena_alloc (&file_arena);
   new->name = new->hname = name;
   new->update_status = us_none;
 
@@ -196,6 +299,7 @@ enter_file (const char *name)
     {
       new->last = new;
       hash_insert_at (&files, new, file_slot);
+      note_new_file (name);
     }
   else
     {
@@ -235,6 +339,8 @@ rehash_file (struct file *from_file, const char *to_hname)
     /* hname changed unexpectedly!! */
     abort ();
 
+  ++rehashed_files;
+
   /* Remove the "from" file from the hash.  */
   deleted_file = hash_delete (&files, from_file);
   if (deleted_file != from_file)
@@ -255,6 +361,7 @@ rehash_file (struct file *from_file, const char *to_hname)
   if (HASH_VACANT (to_file))
     {
       hash_insert_at (&files, from_file, file_slot);
+      note_new_file (to_hname);
       return;
     }
 
@@ -267,7 +374,7 @@ rehash_file (struct file *from_file, const char *to_hname)
         to_file->cmds = from_file->cmds;
       else if (from_file->cmds != to_file->cmds)
         {
-          size_t l = strlen (from_file->name);
+          size_t l = strcache_get_len (from_file->name);
           /* We have two sets of commands.  We will go with the
              one given in the rule explicitly mentioning this name,
              but give a message to let the user know what's going on.  */
@@ -293,6 +400,7 @@ rehash_file (struct file *from_file, const char *to_hname)
 
   /* Merge the dependencies of the two files.  */
 
+  to_file->depset = 0;
   if (to_file->deps == 0)
     to_file->deps = from_file->deps;
   else
@@ -638,6 +746,168 @@ expand_deps (struct file *f)
     }
 }
 
+/* The targets of a rule share its prerequisite list while the makefiles
+   are read, for as long as the list is all the prerequisites a target has:
+   "$(OBJS): config.h" makes one list, not one for each object.  Updating
+   keeps per-target state in the elements, so snap_deps gives each target a
+   copy of its own when the lists are final, and frees these.  */
+
+static struct dep **shared_deps;
+static unsigned int num_shared_deps;
+static unsigned int max_shared_deps;
+
+/* Make DEPS, the prerequisites of a rule with several targets, those of
+   FILE, which has none yet.  FIRST is nonzero for the first target of the
+   rule given DEPS.  */
+
+void
+share_deps (struct file *file, struct dep *deps, int first)
+{
+  if (first)
+    {
+      if (num_shared_deps == max_shared_deps)
+        {
+          max_shared_deps = max_shared_deps ? max_shared_deps * 2 : 64;
+          shared_deps = xrealloc (shared_deps,
+                                  max_shared_deps * sizeof (struct dep *));
+        }
+      shared_deps[num_shared_deps++] = deps;
+    }
+
+  file->deps = deps;
+  file->deps_shared = 1;
+}
+
+/* Give FILE a copy of its own of its prerequisites if they are shared.  */
+
+void
+unshare_deps (struct file *file)
+{
+  if (file->deps_shared)
+    {
+      file->deps = copy_dep_chain (file->deps);
+      file->deps_shared = 0;
+    }
+}
+
+/* Prerequisite lists with at least this many elements are interned.  */
+
+#define DEPSET_MIN 4
+
+static struct hash_table depsets;
+
+static unsigned long
+depset_hash_1 (const void *key)
+{
+  return ((struct depset const *) key)->hash;
+}
+
+static unsigned long
+depset_hash_2 (const void *key)
+{
+  return ((struct depset const *) key)->hash >> 7;
+}
+
+static int
+depset_hash_cmp (const void *x, const void *y)
+{
+  const struct depset *s1 = x;
+  const struct depset *s2 = y;
+
+  if (s1->count != s2->count)
+    return s1->count < s2->count ? -1 : 1;
+  return memcmp (s1->files, s2->files, s1->count * sizeof (struct file *));
+}
+
+/* Find or create the interned set of the files in the COUNT element
+   prerequisite list DEPS.  */
+
+static struct depset *
+intern_depset (const struct dep *deps, unsigned int count)
+{
+  static struct depset *key = 0;
+  static unsigned int key_count = 0;
+  struct depset **slot;
+  struct depset *s;
+  unsigned long hash = 0;
+  unsigned int i;
+
+  if (count > key_count)
+    {
+      key_count = count;
+      key = xrealloc (key, sizeof (struct depset)
+                      + (count - 1) * sizeof (struct file *));
+    }
+
+  for (i = 0; deps != 0; deps = deps->next, ++i)
+    {
+      key->files[i] = deps->file;
+      hash = hash * 31 + ((unsigned long) deps->file >> 3);
+    }
+  key->hash = hash;
+  key->count = count;
+
+  slot = (struct depset **) hash_find_slot (&depsets, key);
+  if (!HASH_VACANT (*slot))
+    return *slot;
+
+  s = xmalloc (sizeof (struct depset) + (count - 1) * sizeof (struct file *));
+  memcpy (s, key, sizeof (struct depset) + (count - 1) * sizeof (struct file *));
+  s->refs = 0;
+  s->checked = 0;
+  s->settled = 0;
+  s->max_mtime = 0;
+  hash_insert_at (&depsets, s, slot);
+  return s;
+}
+
+/* Move the prerequisites of each file into adjacent memory, and intern the
+   longer prerequisite lists.  */
+
+static void
+compact_deps (const void *item)
+{
+  struct file *f;
+
+  for (f = (struct file *) item; f != 0; f = f->prev)
+    {
+      const struct dep *d;
+      unsigned int count = 0;
+
+      for (d = f->deps; d != 0; d = d->next)
+        ++count;
+
+      if (f->deps_shared)
+        unshare_deps (f);
+      else if (count > 1)
+        f->deps = relocate_dep_chain (f->deps, 0);
+
+      if (count >= DEPSET_MIN)
+        {
+          f->depset = intern_depset (f->deps, count);
+          ++f->depset->refs;
+          f->deps->depset_start = 1;
+        }
+    }
+}
+
+/* Forget the interned prerequisite set of a file if no other file shares
+   it: it would never be found up to date before the file is checked.  */
+
+static void
+drop_unshared_depset (const void *item)
+{
+  struct file *f;
+
+  for (f = (struct file *) item; f != 0; f = f->prev)
+    if (f->depset && f->depset->refs == 1)
+      {
+        free (f->depset);
+        f->depset = 0;
+        f->deps->depset_start = 0;
+      }
+}
+
 /* Reset the updating flag.  */
 
 static void
@@ -795,6 +1065,90 @@ snap_deps (void)
                 d2->wait_here = 1;
     }
 
+  f = lookup_file (".STATE_FILE");
+  if (f != NULL && f->is_target)
+    {
+      state_file_name = f->deps != NULL ? f->deps->file->name : ".make.state";
+      state_times = 1;
+    }
+
+  f = lookup_file (".HASHCHECK");
+  if (f != NULL && f->is_target)
+    {
+      if (f->deps == NULL)
+        hash_check_all = 1;
+      else
+        for (d = f->deps; d != 0; d = d->next)
+          for (f2 = d->file; f2 != 0; f2 = f2->prev)
+            f2->hash_check = 1;
+      if (state_file_name == 0)
+        state_file_name = ".make.state";
+      state_hashes = 1;
+    }
+
+  f = lookup_file (".RESTAT");
+  if (f != NULL && f->is_target)
+    {
+      if (f->deps == NULL)
+        restat_all = 1;
+      else
+        for (d = f->deps; d != 0; d = d->next)
+          for (f2 = d->file; f2 != 0; f2 = f2->prev)
+            f2->restat = 1;
+      if (state_file_name == 0)
+        state_file_name = ".make.state";
+      state_restat = 1;
+    }
+
+  f = lookup_file (".CMDCHECK");
+  if (f != NULL && f->is_target)
+    {
+      if (f->deps == NULL)
+        cmd_check_all = 1;
+      else
+        for (d = f->deps; d != 0; d = d->next)
+          for (f2 = d->file; f2 != 0; f2 = f2->prev)
+            f2->cmd_check = 1;
+      if (state_file_name == 0)
+        state_file_name = ".make.state";
+      state_commands = 1;
+    }
+
+  f = lookup_file (".RULECACHE");
+  if (f != NULL && f->is_target)
+    {
+      if (f->deps == NULL)
+        rule_cache_all = 1;
+      else
+        for (d = f->deps; d != 0; d = d->next)
+          for (f2 = d->file; f2 != 0; f2 = f2->prev)
+            f2->rule_cache = 1;
+      if (state_file_name == 0)
+        state_file_name = ".make.state";
+      state_rules = 1;
+    }
+
+  /* The prerequisite lists are now final (apart from what implicit rule
+     search adds later on), and they are what update_file() and
+     set_file_variables() walk over and over.  The chains were built up
+     element by element while reading the makefiles, so their elements are
+     scattered through the dep arena; gather each chain together.
+
+     Many targets (objects depending on the same headers, say) have the same
+     prerequisite list.  Such lists are interned as a shared 'struct depset',
+     which lets update_file_1() check each set once per pass over the goal
+     chain instead of once per target.  */
+  hash_init (&depsets, 1024, depset_hash_1, depset_hash_2, depset_hash_cmp);
+  hash_map (&files, compact_deps);
+  hash_map (&files, drop_unshared_depset);
+  hash_free (&depsets, 0);
+
+  while (num_shared_deps > 0)
+    free_dep_chain (shared_deps[--num_shared_deps]);
+  free (shared_deps);
+  shared_deps = 0;
+  max_shared_deps = 0;
+
 #ifndef NO_MINUS_C_MINUS_O
   /* If .POSIX was defined, remove OUTPUT_OPTION to comply.  */
   /* This needs more work: what if the user sets this in the makefile?
@@ -983,6 +1337,9 @@ print_file (const void *item)
   puts (f->tried_implicit
         ? _("#  Implicit rule search has been done.")
         : _("#  Implicit rule search has not been done."));
+  if (f->intermediates_tried || f->impossibles_known)
+    printf (_("#  Intermediate files looked for: %u; impossible files skipped: %u.\n"),
+            f->intermediates_tried, f->impossibles_known);
   if (f->stem != 0)
     printf (_("#  Implicit/static pattern stem: '%s'\n"), f->stem);
   if (f->intermediate)
@@ -1063,6 +1420,11 @@ print_file_data_base (void)
 
   fputs (_("\n# files hash-table stats:\n# "), stdout);
   hash_print_stats (&files, stdout);
+
+  puts (_("\n# files arena stats:"));
+  arena_print_stats (&file_arena, "#");
+  arena_print_stats (&dep_arena, "#");
+  arena_print_stats (&goaldep_arena, "#");
 }
 
 /* Verify the integrity of the data base of files.  */
@@ -1100,6 +1462,14 @@ verify_file_data_base (void)
   hash_map (&files, verify_file);
 }
 
+/* Call MAP on every file in the data base.  */
+
+void
+map_files (hash_map_func_t map)
+{
+  hash_map (&files, map);
+}
+
 #define EXPANSION_INCREMENT(_l)  ((((_l) / 500) + 1) * 500)
 
 char *
@@ -1124,7 +1494,7 @@ build_target_list (char *value)
         if (!HASH_VACANT (*fp) && (*fp)->is_target)
           {
             struct file *f = *fp;
-            int l = strlen (f->name);
+            int l = strcache_get_len (f->name);
 
             len += l + 1;
             if (len > max)
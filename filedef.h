@@ -23,44 +23,30 @@ this program.  If not, see <http://www.gnu.org/licenses/>.  */
 
 struct file
   {
+    /* The members up to and including the flag bits are the ones looked at
+       for every file on every pass over the goal chain (update_file(),
+       check_dep(), check_renamed()).  Keep them together at the start, so
+       they share as few cache lines as possible; colder members follow.  */
+
     const char *name;
-    const char *hname;          /* Hashed filename */
-    const char *vpath_orgname;  /* original target name, before VPATH/vpath lookup */
     struct dep *deps;           /* all dependencies, including duplicates */
-    struct commands *cmds;      /* Commands to execute for this target.  */
-    const char *stem;           /* Implicit stem, if an implicit
-                                   rule has been used */
-    struct dep *also_make;      /* Targets that are made by making this.  */
-    struct file *prev;          /* Previous entry for same file name;
-                                   used when there are multiple double-colon
-                                   entries for the same file.  */
-    struct file *last;          /* Last entry for the same file name.  */
 
     /* File that this file was renamed to.  After any time that a
        file could be renamed, call 'check_renamed' (below).  */
     struct file *renamed;
 
-    /* List of variable sets used for this file.  */
-    struct variable_set_list *variables;
-
-    /* Pattern-specific variable reference for this target, or null if there
-       isn't one.  Also see the pat_searched flag, below.  */
-    struct variable_set_list *pat_variables;
-
-    /* Immediate dependent that caused this target to be remade,
-       or nil if there isn't one.  */
-    struct file *parent;
-
     /* For a double-colon entry, this is the first double-colon entry for
        the same file.  Otherwise this is null.  */
     struct file *double_colon;
 
+    struct file *prev;          /* Previous entry for same file name;
+                                   used when there are multiple double-colon
+                                   entries for the same file.  */
+    struct commands *cmds;      /* Commands to execute for this target.  */
+
     FILE_TIMESTAMP last_mtime;  /* File's modtime, if already known.  */
-    FILE_TIMESTAMP mtime_before_update; /* File's modtime before any updating
-                                           has been performed.  */
     unsigned int considered;    /* equal to 'considered' if file has been
                                    considered on current scan of goal chain */
-    int command_flags;          /* Flags OR'd in for cmds; see commands.h.  */
     enum update_status          /* Status of the last attempt to update.  */
       {
         us_success = 0,         /* Successfully updated.  Must be 0!  */
@@ -105,6 +91,66 @@ struct file
                                    diagnostics has been issued (dontcare). */
     unsigned int is_renamed:1;  /* Nonzero if the name was changed, e.g. because
                                    of a target vpath. */
+    unsigned int mtime_queued:1;/* Nonzero if seen by prefetch_mtimes().  */
+    unsigned int watched:1;     /* Nonzero if the server hears of changes to
+                                   this file; see server.c.  */
+    unsigned int hash_check:1;  /* Nonzero if compared by content when it is
+                                   newer than a target; see .HASHCHECK.  */
+    unsigned int restat:1;      /* Nonzero if looked at again after its
+                                   recipe has run; see .RESTAT.  */
+    unsigned int cmd_check:1;   /* Nonzero if the recipe that made it is
+                                   recorded; see .CMDCHECK.  */
+    unsigned int rule_cache:1;  /* Nonzero if the implicit rule search for
+                                   it is recorded; see .RULECACHE.  */
+    unsigned int deps_shared:1; /* Nonzero if 'deps' is shared with other
+                                   targets of its rule; see snap_deps.  */
+
+    const char *hname;          /* Hashed filename */
+    const char *vpath_orgname;  /* original target name, before VPATH/vpath lookup */
+    const char *stem;           /* Implicit stem, if an implicit
+                                   rule has been used */
+    struct dep *also_make;      /* Targets that are made by making this.  */
+    struct file *last;          /* Last entry for the same file name.  */
+    struct depset *depset;      /* Interned set of 'deps', or null.  */
+
+    /* List of variable sets used for this file.  */
+    struct variable_set_list *variables;
+
+    /* Pattern-specific variable reference for this target, or null if there
+       isn't one.  Also see the pat_searched flag, above.  */
+    struct variable_set_list *pat_variables;
+
+    /* Immediate dependent that caused this target to be remade,
+       or nil if there isn't one.  */
+    struct file *parent;
+
+    FILE_TIMESTAMP mtime_before_update; /* File's modtime before any updating
+                                           has been performed.  */
+    int command_flags;          /* Flags OR'd in for cmds; see commands.h.  */
+
+    /* Intermediate files the implicit rule search for this target looked
+       for, and how many prerequisites it found already ruled impossible.  */
+    unsigned int intermediates_tried;
+    unsigned int impossibles_known;
+  };
+
+
+/* An interned prerequisite list.  Targets whose 'deps' name the same files
+   in the same order share one of these.  It records whether, on the current
+   pass over the goal chain, all of the files were found up to date, and the
+   newest of their modification times; see update_file_1().  */
+
+struct depset
+  {
+    unsigned long hash;         /* Hash of the file pointers.  */
+    unsigned int count;         /* Number of files.  */
+    unsigned int refs;          /* Number of targets sharing this set.  */
+    unsigned int checked;       /* Pass of the goal chain the set was
+                                   last checked on.  */
+    unsigned int settled:1;     /* Nonzero if all files were up to date
+                                   when it was checked.  */
+    FILE_TIMESTAMP max_mtime;   /* Newest modtime of the files, if settled.  */
+    struct file *files[1];      /* The files, in order.  */
   };
 
 
@@ -115,6 +161,8 @@ struct file *lookup_file (const char *name);
 struct file *enter_file (const char *name);
 struct dep *split_prereqs (char *prereqstr);
 struct dep *enter_prereqs (struct dep *prereqs, const char *stem);
+void share_deps (struct file *file, struct dep *deps, int first);
+void unshare_deps (struct file *file);
 void remove_intermediates (int sig);
 void snap_deps (void);
 void rename_file (struct file *file, const char *name);
@@ -123,6 +171,8 @@ void set_command_state (struct file *file, enum cmd_state state);
 void notice_finished_file (struct file *file);
 void init_hash_files (void);
 void verify_file_data_base (void);
+void map_files (hash_map_func_t map);
+int file_extension_p (const char *dir, size_t dirlen, const char *ext);
 char *build_target_list (char *old_list);
 void print_prereqs (const struct dep *deps);
 void print_file_data_base (void);
@@ -215,3 +265,39 @@ FILE_TIMESTAMP f_mtime (struct file *file, int search);
 
 /* Have we snapped deps yet?  */
 extern int snapped_deps;
+
+/* Number of times a file has been given a new name.  */
+extern unsigned int rehashed_files;
+
+/* Bumped when file_extension_p may give a new answer.  */
+extern unsigned long file_extension_generation;
+
+/* The state file named by .STATE_FILE, if any, and what it records.
+   See state.c.  */
+extern const char *state_file_name;
+extern int state_times;
+extern int state_hashes;
+extern int state_restat;
+extern int state_commands;
+extern int state_rules;
+extern int hash_check_all;
+extern int restat_all;
+extern int cmd_check_all;
+extern int rule_cache_all;
+void load_state (void);
+int state_mtime (struct file *file, FILE_TIMESTAMP *mtime);
+int hash_unchanged (struct file *file);
+FILE_TIMESTAMP restat_mtime (struct file *file, FILE_TIMESTAMP mtime);
+int restat_unchanged (struct file *file);
+void start_restat (struct file *file);
+void finish_restat (struct file *file);
+int recipe_changed (struct file *file);
+void finish_recipe (struct file *file);
+int replay_rule_search (struct file *file, unsigned int *found);
+void start_rule_search (struct file *file);
+void note_rule_probe (const char *name);
+void finish_rule_search (struct file *file, unsigned int found);
+void stop_rule_searches (void);
+void invalidate_state (void);
+void reset_state (void);
+void save_state (void);
@@ -387,7 +387,7 @@ string_glob (char *line)
 
       /* Because we used PARSEFS_NOCACHE above, we have to free() NAME.  */
       free ((char *)chain->name);
-      free (chain);
+      free_ns (chain);
       chain = next;
     }
 
@@ -971,6 +971,7 @@ func_foreach (char *o, char **argv, const char *funcname UNUSED)
 
       free (var->value);
       var->value = xstrndup (p, len);
+      var->value_size = 0;
 
       result = allocated_variable_expand (body);
 
@@ -2033,6 +2034,8 @@ func_shell_base (char *o, char **argv, int trim_newlines)
     out.out = pipedes[1];
     out.err = errfd;
 
+    /* The command may change the directories.  */
+    close_directory_fds ();
     pid = child_execute_job (&out, 1, command_argv, envp);
   }
 
@@ -2607,6 +2610,25 @@ static struct function_table_entry function_table_init[] =
 
 /* These must come after the definition of function_table.  */
 
+/* While NO_SIDE_EFFECTS is nonzero, functions that do more than return text
+   expand to nothing, and SIDE_EFFECTS_SKIPPED counts them.  */
+
+int no_side_effects = 0;
+unsigned int side_effects_skipped = 0;
+
+/* Return nonzero if ENTRY_P runs commands, prints, reads makefile text or
+   writes files.  Loaded functions might do any of these.  */
+
+static int
+has_side_effects (const struct function_table_entry *entry_p)
+{
+  return (entry_p->alloc_fn
+          || entry_p->fptr.func_ptr == func_shell
+          || entry_p->fptr.func_ptr == func_error
+          || entry_p->fptr.func_ptr == func_eval
+          || entry_p->fptr.func_ptr == func_file);
+}
+
 static char *
 expand_builtin_function (char *o, unsigned int argc, char **argv,
                          const struct function_table_entry *entry_p)
@@ -2625,6 +2647,12 @@ expand_builtin_function (char *o, unsigned int argc, char **argv,
   if (!argc && !entry_p->alloc_fn)
     return o;
 
+  if (no_side_effects && has_side_effects (entry_p))
+    {
+      ++side_effects_skipped;
+      return o;
+    }
+
   if (!entry_p->fptr.func_ptr)
     OS (fatal, *expanding_var,
         _("unimplemented on this platform: function '%s'"), entry_p->name);
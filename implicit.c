@@ -31,7 +31,239 @@ this program.  If not, see <https://www.gnu.org/licenses/>.  */
 #endif
 
 static int pattern_search (struct file *file, int archive,
-                           unsigned int depth, unsigned int recursions);
+                           unsigned int depth, unsigned int recursions,
+                           const struct rule_target *replay);
+
+/* What the implicit rule search under way has done, for its target: how
+   many intermediate files it looked for, and how many prerequisites it
+   passed over because an earlier search, for any target, had found them
+   impossible to make.  Each failed search for an intermediate file marks
+   it impossible, so it is looked for at most once per run; the chains are
+   bounded since a rule is not tried again while it is in use.  */
+
+static unsigned int intermediates_tried;
+static unsigned int impossibles_known;
+
+#if !defined(VMS) && !defined(WINDOWS32) && !defined(HAVE_DOS_PATHS) \
+    && !defined(HAVE_CASE_INSENSITIVE_FS)
+# define SHAPE_MEMO 1
+#endif
+
+#ifdef SHAPE_MEMO
+
+/* Thousands of targets in one directory tend to go through the same
+   implicit rules, differing only in their stems, and most of the rules fail
+   for all of them alike: a prerequisite like src/STEM.cc cannot exist if
+   nothing in src has the extension .cc, nothing such is mentioned in the
+   makefiles, and no search path could find one.  Whether that holds
+   depends only on the shape of the name, its directory and extension, and
+   is remembered per shape.  The answers are worked out again when
+   directories, the data base or the search paths change.  */
+
+struct shape
+  {
+    const char *key;            /* Directory, with its slash, and extension.  */
+    unsigned long stamp;        /* shape_stamp () when ABSENT was found.  */
+    int absent;                 /* Nonzero if no such file can exist.  */
+  };
+
+static struct hash_table shapes;
+
+static unsigned long
+shape_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 (((const struct shape *) key)->key);
+}
+
+static unsigned long
+shape_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (((const struct shape *) key)->key);
+}
+
+static int
+shape_hash_cmp (const void *x, const void *y)
+{
+  return_STRING_COMPARE (((const struct shape *) x)->key,
+                         ((const struct shape *) y)->key);
+}
+
+/* The generations only go up, so their sum changes whenever one does.  */
+
+static unsigned long
+shape_stamp (void)
+{
+  return dir_extension_generation + file_extension_generation
+         + vpath_generation;
+}
+
+/* Return nonzero if no file can exist in directory DIR, DIRLEN bytes long
+   and ending in a slash unless it is empty, whose name ends in EXT.  */
+
+static int
+shape_absent (const char *dir, size_t dirlen, const char *ext)
+{
+  size_t extlen = strlen (ext);
+  char *key = alloca (dirlen + extlen + 1);
+  unsigned long stamp = shape_stamp ();
+  struct shape shape_key;
+  struct shape **slot;
+  struct shape *sh;
+  const char *dirname;
+
+  memcpy (key, dir, dirlen);
+  memcpy (key + dirlen, ext, extlen + 1);
+
+  if (shapes.ht_vec == 0)
+    hash_init (&shapes, 61, shape_hash_1, shape_hash_2, shape_hash_cmp);
+
+  shape_key.key = key;
+  slot = (struct shape **) hash_find_slot (&shapes, &shape_key);
+  sh = *slot;
+  if (HASH_VACANT (sh))
+    {
+      sh = xmalloc (sizeof (struct shape));
+      sh->key = strcache_add (key);
+      hash_insert_at (&shapes, sh, slot);
+    }
+  else if (sh->stamp == stamp)
+    return sh->absent;
+
+  if (dirlen == 0)
+    dirname = ".";
+  else if (dirlen == 1)
+    dirname = "/";
+  else
+    {
+      char *cp = alloca (dirlen);
+      memcpy (cp, dir, dirlen - 1);
+      cp[dirlen - 1] = '\0';
+      dirname = cp;
+    }
+
+  sh->absent = (!dir_extension_p (dirname, ext)
+                && !file_extension_p (dir, dirlen, ext)
+                && !vpath_extension_p (dir, dirlen, ext));
+  sh->stamp = stamp;
+
+  return sh->absent;
+}
+
+/* Return nonzero if NAME is in directory DIR, DIRLEN bytes long, and ends
+   in the extension EXT.  */
+
+static int
+name_has_shape (const char *name, const char *dir, size_t dirlen,
+                const char *ext)
+{
+  const char *dot;
+
+  if (!strneq (name, dir, dirlen) || strchr (name + dirlen, '/') != 0)
+    return 0;
+  dot = strrchr (name + dirlen, '.');
+  return dot != 0 && streq (dot, ext);
+}
+
+/* Return nonzero if a prerequisite of RULE cannot exist when a file named
+   FILENAME, with the prerequisites DEPS mentioned for it, is made from it
+   with the stem STEM, STEMLEN bytes long, as far as can be told from the
+   shapes of the prerequisites.  If so, its name is left in DEPNAME.
+   PATHDIR, PATHLEN bytes long, is put in front of the prerequisites if it
+   is nonnull, as pattern_search does.  */
+
+static int
+rule_absent_dep (struct rule *rule, const struct dep *deps,
+                 const char *filename, const char *pathdir, size_t pathlen,
+                 const char *stem, size_t stemlen, char *depname)
+{
+  struct dep *dep;
+
+  /* Names with these are parsed into something else.  */
+  if (strpbrk (filename, " \t*?[()~$\\") != 0)
+    return 0;
+
+  for (dep = rule->deps; dep != 0; dep = dep->next)
+    {
+      const char *nptr = dep_name (dep);
+      const char *p = strchr (nptr, '%');
+      const char *ext;
+      const char *slash;
+      const struct dep *d;
+      char *o = depname;
+      size_t dirlen;
+
+      /* Only a prerequisite with no directory after the stem has a shape
+         that does not depend on what is in the stem.  Its extension may
+         come from the stem, as for a file checked out of RCS.  */
+      if (dep->need_2nd_expansion || p == 0 || strchr (p + 1, '/') != 0
+          || strpbrk (nptr, " \t*?[()~$\\") != 0)
+        continue;
+
+      if (pathdir != 0)
+        {
+          memcpy (o, pathdir, pathlen);
+          o += pathlen;
+        }
+      memcpy (o, nptr, p - nptr);
+      o += p - nptr;
+      memcpy (o, stem, stemlen);
+      o += stemlen;
+      strcpy (o, p + 1);
+
+      if (depname[0] == '.' && depname[1] == '/')
+        continue;
+
+      slash = strrchr (depname, '/');
+      dirlen = slash != 0 ? slash - depname + 1 : 0;
+      ext = strrchr (depname + dirlen, '.');
+      if (ext == 0)
+        ext = "";
+
+      /* A prerequisite mentioned for the file itself is always used.  */
+      for (d = deps; d != 0; d = d->next)
+        if (name_has_shape (dep_name (d), depname, dirlen, ext))
+          break;
+      if (d != 0)
+        continue;
+
+      if (shape_absent (depname, dirlen, ext))
+        return 1;
+    }
+
+  return 0;
+}
+
+/* Return nonzero if none of anything_rules can make NAME, not being used
+   already, because a prerequisite of each cannot exist.  Those are the
+   only rules that pattern_search would try for it as an intermediate file
+   of RULE when RULE->chains is 2.  */
+
+static int
+anything_rules_absent (const char *name)
+{
+  const char *slash = strrchr (name, '/');
+  size_t pathlen = slash != 0 ? slash - name + 1 : 0;
+  size_t stemlen = strlen (name + pathlen);
+  char *depname = alloca (pathlen + stemlen + max_pattern_dep_length + 1);
+  unsigned int i;
+
+  for (i = 0; i < num_anything_rules; ++i)
+    {
+      struct rule *r = anything_rules[i];
+
+      if (r->in_use)
+        continue;
+      if (r->deps == 0
+          || !rule_absent_dep (r, 0, name, pathlen != 0 ? name : 0, pathlen,
+                               name + pathlen, stemlen, depname))
+        return 0;
+      note_rule_probe (depname);
+    }
+
+  return 1;
+}
+
+#endif /* SHAPE_MEMO */
 
 /* For a FILE which has no commands specified, try to figure out some
    from the implicit pattern rules.
@@ -42,29 +274,53 @@ static int pattern_search (struct file *file, int archive,
 int
 try_implicit_rule (struct file *file, unsigned int depth)
 {
+  unsigned int found;
+
   DBF (DB_IMPLICIT, _("Looking for an implicit rule for '%s'.\n"));
 
+  /* If the search for FILE was recorded and would come out the same, go
+     straight to the rule it found.  See .RULECACHE in state.c.  */
+  if (replay_rule_search (file, &found))
+    {
+      struct rule_target target;
+
+      DBF (DB_IMPLICIT,
+           _("Using the recorded implicit rule search for '%s'.\n"));
+      if (found == 0)
+        return 0;
+      if (find_pattern_target (found - 1, &target)
+          && pattern_search (file, 0, depth, 0, &target))
+        return 1;
+    }
+
   /* The order of these searches was previously reversed.  My logic now is
      that since the non-archive search uses more information in the target
      (the archive search omits the archive name), it is more specific and
      should come first.  */
 
-  if (pattern_search (file, 0, depth, 0))
-    return 1;
+  start_rule_search (file);
+  intermediates_tried = impossibles_known = 0;
+  found = pattern_search (file, 0, depth, 0, 0);
 
 #ifndef NO_ARCHIVES
   /* If this is an archive member reference, use just the
      archive member name to search for implicit rules.  */
-  if (ar_name (file->name))
+  if (!found && ar_name (file->name))
     {
       DBF (DB_IMPLICIT,
            _("Looking for archive-member implicit rule for '%s'.\n"));
-      if (pattern_search (file, 1, depth, 0))
-        return 1;
+      found = pattern_search (file, 1, depth, 0, 0);
     }
 #endif
 
-  return 0;
+  file->intermediates_tried = intermediates_tried;
+  file->impossibles_known = impossibles_known;
+  if (intermediates_tried || impossibles_known)
+    DBS (DB_IMPLICIT,
+         (_("Looked for %u intermediate files for '%s'; skipped %u impossible files.\n"),
+          intermediates_tried, file->name, impossibles_known));
+
+  return found;
 }
 
 /* Scans the BUFFER for the next word with whitespace as a separator.
@@ -175,6 +431,9 @@ struct tryrule
     /* Index of the target in this rule that matched the file. */
     unsigned int matches;
 
+    /* Number of that target among all pattern rule targets.  */
+    unsigned int num;
+
     /* Definition order of this rule. Used to implement stable sort.*/
     unsigned int order;
 
@@ -203,17 +462,23 @@ stemlen_compare (const void *v1, const void *v2)
    is set up as a target by the recursive call and is also made a dependency
    of FILE.
 
+   If REPLAY is not nil, it is the rule target that a recorded search found
+   for FILE.  Only that one is tried, and its prerequisites are taken to
+   exist without looking for them.
+
    DEPTH is used for debugging messages.  */
 
 static int
 pattern_search (struct file *file, int archive,
-                unsigned int depth, unsigned int recursions)
+                unsigned int depth, unsigned int recursions,
+                const struct rule_target *replay)
 {
   /* Filename we are searching for a rule for.  */
   const char *filename = archive ? strchr (file->name, '(') : (file->is_renamed ? file->vpath_orgname : file->name);
 
-  /* Length of FILENAME.  */
-  size_t namelen = strlen (filename);
+  /* Length of FILENAME.  Unless it is an archive member, it is a cached
+     string and we can get it from the strcache.  */
+  size_t namelen = archive ? strlen (filename) : strcache_get_len (filename);
 
   /* The last slash in FILENAME (or nil if there is none).  */
   const char *lastslash;
@@ -238,9 +503,13 @@ pattern_search (struct file *file, int archive,
   size_t stemlen = 0;
   size_t fullstemlen = 0;
 
+  /* The pattern rule targets that may match FILENAME, and how many.  */
+  struct rule_target *targets;
+  unsigned int ntargets;
+  unsigned int ci;
+
   /* Buffer in which we store all the rules that are possibly applicable.  */
-  struct tryrule *tryrules = xmalloc (num_pattern_rules * max_pattern_targets
-                                      * sizeof (struct tryrule));
+  struct tryrule *tryrules;
 
   /* Number of valid elements in TRYRULES.  */
   unsigned int nrules;
@@ -302,12 +571,28 @@ pattern_search (struct file *file, int archive,
   pathlen = lastslash ? lastslash - filename + 1 : 0;
 
   /* First see which pattern rules match this target and may be considered.
-     Put them in TRYRULES.  */
+     Put them in TRYRULES.  Only the targets the index finds for FILENAME
+     can match it, and they come in the order of the rules.  */
+
+  if (replay != 0)
+    {
+      targets = xmalloc (sizeof (struct rule_target));
+      targets[0] = *replay;
+      ntargets = 1;
+    }
+  else
+    ntargets = find_pattern_targets (filename, namelen, lastslash, &targets);
+  tryrules = xmalloc (ntargets * sizeof (struct tryrule));
 
   nrules = 0;
-  for (rule = pattern_rules; rule != 0; rule = rule->next)
+  for (ci = 0; ci < ntargets; ++ci)
     {
-      unsigned int ti;
+      unsigned int ti = targets[ci].ti;
+      const char *target;
+      const char *suffix;
+      char check_lastslash;
+
+      rule = targets[ci].rule;
 
       /* If the pattern rule has deps but no commands, ignore it.
          Users cancel built-in rules by redefining them without commands.  */
@@ -318,103 +603,104 @@ pattern_search (struct file *file, int archive,
          don't use it here.  */
       if (rule->in_use)
         {
-          DBS (DB_IMPLICIT,
-               (_("Avoiding implicit rule recursion for rule '%s'.\n"),
-                get_rule_defn (rule)));
+          if (ci == 0 || targets[ci - 1].rule != rule)
+            DBS (DB_IMPLICIT,
+                 (_("Avoiding implicit rule recursion for rule '%s'.\n"),
+                  get_rule_defn (rule)));
           continue;
         }
 
-      for (ti = 0; ti < rule->num; ++ti)
-        {
-          const char *target = rule->targets[ti];
-          const char *suffix = rule->suffixes[ti];
-          char check_lastslash;
+      target = rule->targets[ti];
+      suffix = rule->suffixes[ti];
 
-          /* Rules that can match any filename and are not terminal
-             are ignored if we're recursing, so that they cannot be
-             intermediate files.  */
-          if (recursions > 0 && target[1] == '\0' && !rule->terminal)
-            continue;
+      /* Rules that can match any filename and are not terminal
+         are ignored if we're recursing, so that they cannot be
+         intermediate files.  */
+      if (recursions > 0 && target[1] == '\0' && !rule->terminal)
+        continue;
 
-          if (rule->lens[ti] > namelen)
-            /* It can't possibly match.  */
-            continue;
+      if (rule->lens[ti] > namelen)
+        /* It can't possibly match.  */
+        continue;
 
-          /* From the lengths of the filename and the pattern parts,
-             find the stem: the part of the filename that matches the %.  */
-          stem = filename + (suffix - target - 1);
-          stemlen = namelen - rule->lens[ti] + 1;
+      /* From the lengths of the filename and the pattern parts,
+         find the stem: the part of the filename that matches the %.  */
+      stem = filename + (suffix - target - 1);
+      stemlen = namelen - rule->lens[ti] + 1;
 
-          /* Set CHECK_LASTSLASH if FILENAME contains a directory
-             prefix and the target pattern does not contain a slash.  */
+      /* Set CHECK_LASTSLASH if FILENAME contains a directory
+         prefix and the target pattern does not contain a slash.  */
 
-          check_lastslash = 0;
-          if (lastslash)
-            {
+      check_lastslash = 0;
+      if (lastslash)
+        {
 #ifdef VMS
-              check_lastslash = strpbrk (target, "/]>:") == NULL;
+          check_lastslash = strpbrk (target, "/]>:") == NULL;
 #else
-              check_lastslash = strchr (target, '/') == 0;
+          check_lastslash = strchr (target, '/') == 0;
 #endif
 #ifdef HAVE_DOS_PATHS
-              /* Didn't find it yet: check for DOS-type directories.  */
-              if (check_lastslash)
-                {
-                  char *b = strchr (target, '\\');
-                  check_lastslash = !(b || (target[0] && target[1] == ':'));
-                }
-#endif
-            }
+          /* Didn't find it yet: check for DOS-type directories.  */
           if (check_lastslash)
             {
-              /* If so, don't include the directory prefix in STEM here.  */
-              if (pathlen > stemlen)
-                continue;
-              stemlen -= pathlen;
-              stem += pathlen;
-            }
-
-          /* Check that the rule pattern matches the text before the stem.  */
-          if (check_lastslash)
-            {
-              if (stem > (lastslash + 1)
-                  && !strneq (target, lastslash + 1, stem - lastslash - 1))
-                continue;
+              char *b = strchr (target, '\\');
+              check_lastslash = !(b || (target[0] && target[1] == ':'));
             }
-          else if (stem > filename
-                   && !strneq (target, filename, stem - filename))
+#endif
+        }
+      if (check_lastslash)
+        {
+          /* If so, don't include the directory prefix in STEM here.  */
+          if (pathlen > stemlen)
             continue;
+          stemlen -= pathlen;
+          stem += pathlen;
+        }
 
-          /* Check that the rule pattern matches the text after the stem.
-             We could test simply use streq, but this way we compare the
-             first two characters immediately.  This saves time in the very
-             common case where the first character matches because it is a
-             period.  */
-          if (*suffix != stem[stemlen]
-              || (*suffix != '\0' && !streq (&suffix[1], &stem[stemlen + 1])))
+      /* Check that the rule pattern matches the text before the stem.  */
+      if (check_lastslash)
+        {
+          if (stem > (lastslash + 1)
+              && !strneq (target, lastslash + 1, stem - lastslash - 1))
             continue;
+        }
+      else if (stem > filename
+               && !strneq (target, filename, stem - filename))
+        continue;
 
-          /* Record if we match a rule that not all filenames will match.  */
-          if (target[1] != '\0')
-            specific_rule_matched = 1;
+      /* Check that the rule pattern matches the text after the stem.
+         We could test simply use streq, but this way we compare the
+         first two characters immediately.  This saves time in the very
+         common case where the first character matches because it is a
+         period.  */
+      if (*suffix != stem[stemlen]
+          || (*suffix != '\0' && !streq (&suffix[1], &stem[stemlen + 1])))
+        continue;
 
-          /* A rule with no dependencies and no commands exists solely to set
-             specific_rule_matched when it matches.  Don't try to use it.  */
-          if (rule->deps == 0 && rule->cmds == 0)
-            continue;
+      /* Record if we match a rule that not all filenames will match.  */
+      if (target[1] != '\0')
+        specific_rule_matched = 1;
 
-          /* Record this rule in TRYRULES and the index of the matching
-             target in MATCHES.  If several targets of the same rule match,
-             that rule will be in TRYRULES more than once.  */
-          tryrules[nrules].rule = rule;
-          tryrules[nrules].matches = ti;
-          tryrules[nrules].stemlen = stemlen + (check_lastslash ? pathlen : 0);
-          tryrules[nrules].order = nrules;
-          tryrules[nrules].checked_lastslash = check_lastslash;
-          ++nrules;
-        }
+      /* A rule with no dependencies and no commands exists solely to set
+         specific_rule_matched when it matches.  Don't try to use it.  */
+      if (rule->deps == 0 && rule->cmds == 0)
+        continue;
+
+      /* Record this rule in TRYRULES and the index of the matching
+         target in MATCHES.  If several targets of the same rule match,
+         that rule will be in TRYRULES more than once.  */
+      tryrules[nrules].rule = rule;
+      tryrules[nrules].matches = ti;
+      tryrules[nrules].num = targets[ci].num;
+      tryrules[nrules].stemlen = stemlen + (check_lastslash ? pathlen : 0);
+      tryrules[nrules].order = nrules;
+      tryrules[nrules].checked_lastslash = check_lastslash;
+      ++nrules;
     }
 
+  free (targets);
+  rule = 0;
+
   /* Bail out early if we haven't found any rules. */
   if (nrules == 0)
     goto done;
@@ -444,7 +730,18 @@ pattern_search (struct file *file, int archive,
     {
       pat = deplist;
       if (intermed_ok)
-        DBS (DB_IMPLICIT, (_("Trying harder.\n")));
+        {
+          /* Only a rule with a prerequisite another rule may make is
+             worth trying again.  */
+          for (ri = 0; ri < nrules; ++ri)
+            if (tryrules[ri].rule != 0 && !tryrules[ri].rule->terminal
+                && tryrules[ri].rule->chains)
+              break;
+          if (ri == nrules)
+            break;
+
+          DBS (DB_IMPLICIT, (_("Trying harder.\n")));
+        }
 
       /* Try each pattern rule till we find one that applies.  If it does,
          expand its dependencies (as substituted) and chain them in DEPS.  */
@@ -468,8 +765,8 @@ pattern_search (struct file *file, int archive,
             continue;
 
           /* Reject any terminal rules if we're looking to make intermediate
-             files.  */
-          if (intermed_ok && rule->terminal)
+             files, and any rules that cannot use them.  */
+          if (intermed_ok && (rule->terminal || !rule->chains))
             continue;
 
           /* From the lengths of the filename and the matching pattern parts,
@@ -523,6 +820,22 @@ pattern_search (struct file *file, int archive,
           if (rule->deps == 0)
             break;
 
+#ifdef SHAPE_MEMO
+          /* Without intermediate files the rule fails if a prerequisite
+             cannot exist.  */
+          if (!intermed_ok && replay == 0
+              && rule_absent_dep (rule, file->deps, filename,
+                                  check_lastslash ? pathdir : 0, pathlen,
+                                  stem, stemlen, depname))
+            {
+              note_rule_probe (depname);
+              DBS (DB_IMPLICIT,
+                   (_("Rejecting rule prerequisite '%s': no such file can exist.\n"),
+                    depname));
+              continue;
+            }
+#endif
+
           /* Mark this rule as in use so a recursive pattern_search won't try
              to use it.  */
           rule->in_use = 1;
@@ -564,7 +877,7 @@ pattern_search (struct file *file, int archive,
                         }
                       memcpy (o, nptr, p - nptr);
                       o += p - nptr;
-                      memcpy (o, stem_str, stemlen);
+                      memcpy (o, stem, stemlen);
                       o += stemlen;
                       strcpy (o, p + 1);
                     }
@@ -714,6 +1027,8 @@ pattern_search (struct file *file, int archive,
 
                   if (file_impossible_p (d->name))
                     {
+                      ++impossibles_known;
+                      note_rule_probe (d->name);
                       /* If this prereq has already been ruled "impossible",
                          then the rule fails.  Don't bother trying it on the
                          second pass either since we know that will fail.  */
@@ -745,12 +1060,14 @@ pattern_search (struct file *file, int archive,
                   for (expl_d = file->deps; expl_d != 0; expl_d = expl_d->next)
                     if (streq (dep_name (expl_d), d->name))
                       break;
-                  if (expl_d != 0)
+                  if (expl_d != 0 || replay != 0)
                     {
                       (pat++)->name = d->name;
                       continue;
                     }
 
+                  note_rule_probe (d->name);
+
                   /* The DEP->changed flag says that this dependency resides
                      in a nonexistent directory.  So we normally can skip
                      looking for the file.  However, if CHECK_LASTSLASH is
@@ -791,6 +1108,19 @@ pattern_search (struct file *file, int archive,
                       DBS (DB_IMPLICIT,
                            (_("Looking for a rule with intermediate file '%s'.\n"),
                             d->name));
+                      ++intermediates_tried;
+
+#ifdef SHAPE_MEMO
+                      if (rule->chains == 2 && anything_rules_absent (d->name))
+                        {
+                          DBS (DB_IMPLICIT,
+                               (_("Rejecting intermediate file '%s': no rule can make it.\n"),
+                                d->name));
+                          file_impossible (d->name);
+                          failed = 1;
+                          break;
+                        }
+#endif
 
                       if (int_file == 0)
                         int_file = alloca (sizeof (struct file));
@@ -800,7 +1130,8 @@ pattern_search (struct file *file, int archive,
                       if (pattern_search (int_file,
                                           0,
                                           depth + 1,
-                                          recursions + 1))
+                                          recursions + 1,
+                                          0))
                         {
                           pat->pattern = int_file->name;
                           int_file->name = d->name;
@@ -853,6 +1184,10 @@ pattern_search (struct file *file, int archive,
         break;
 
       rule = 0;
+
+      /* A recorded rule that no longer applies is searched for anew.  */
+      if (replay != 0)
+        break;
     }
 
   /* RULE is nil if the loop went through the list but everything failed.  */
@@ -888,6 +1223,9 @@ pattern_search (struct file *file, int archive,
           struct file *imf = pat->file;
           struct file *f = lookup_file (imf->name);
 
+          /* Later searches may find the intermediate file now.  */
+          stop_rule_searches ();
+
           /* We don't want to delete an intermediate file that happened
              to be a prerequisite of some (other) target. Mark it as
              secondary.  We don't want it to be precious as that disables
@@ -898,6 +1236,7 @@ pattern_search (struct file *file, int archive,
             f = enter_file (imf->name);
 
           f->deps = imf->deps;
+          f->depset = 0;
           f->cmds = imf->cmds;
           f->stem = imf->stem;
           f->variables = imf->variables;
@@ -1012,6 +1351,9 @@ pattern_search (struct file *file, int archive,
           new->file = enter_file (new->name);
           new->next = file->also_make;
 
+          /* Later searches may find this target now.  */
+          stop_rule_searches ();
+
           /* Set precious flag. */
           f = lookup_file (rule->targets[ri]);
           if (f)
@@ -1031,6 +1373,8 @@ pattern_search (struct file *file, int archive,
         }
 
  done:
+  if (recursions == 0 && !archive && replay == 0)
+    finish_rule_search (file, rule != 0 ? tryrules[foundrule].num + 1 : 0);
   free (tryrules);
   free (deplist);
 
@@ -1730,43 +1730,16 @@ start_waiting_job (struct child *c)
   return 1;
 }
 
-/* Create a 'struct child' for FILE and start its commands running.  */
+/* Expand the recipe of FILE, which has been chopped into lines, in the
+   context of FILE and return the lines in a new vector.  */
 
-void
-new_job (struct file *file)
+char **
+expand_command_lines (struct file *file)
 {
   struct commands *cmds = file->cmds;
-  struct child *c;
   char **lines;
   unsigned int i;
 
-  /* Let any previously decided-upon jobs that are waiting
-     for the load to go down start before this new one.  */
-  start_waiting_jobs ();
-
-  /* Reap any children that might have finished recently.  */
-  reap_children (0, 0);
-
-  /* Chop the commands up into lines if they aren't already.  */
-  chop_commands (cmds);
-
-  /* Start the command sequence, record it in a new
-     'struct child', and add that to the chain.  */
-
-  c = xcalloc (sizeof (struct child));
-  output_init (&c->output);
-
-  c->file = file;
-  c->sh_batch_file = NULL;
-
-  /* Cache dontcare flag because file->dontcare can be changed once we
-     return. Check dontcare inheritance mechanism for details.  */
-  c->dontcare = file->dontcare;
-
-  /* Start saving output in case the expansion uses $(info ...) etc.  */
-  OUTPUT_SET (&c->output);
-
-  /* Expand the command lines and store the results in LINES.  */
   lines = xmalloc (cmds->ncommand_lines * sizeof (char *));
   for (i = 0; i < cmds->ncommand_lines; ++i)
     {
@@ -1871,7 +1844,45 @@ new_job (struct file *file)
     }
 
   cmds->fileinfo.offset = 0;
-  c->command_lines = lines;
+  return lines;
+}
+
+/* Create a 'struct child' for FILE and start its commands running.  */
+
+void
+new_job (struct file *file)
+{
+  struct commands *cmds = file->cmds;
+  struct child *c;
+
+  /* Let any previously decided-upon jobs that are waiting
+     for the load to go down start before this new one.  */
+  start_waiting_jobs ();
+
+  /* Reap any children that might have finished recently.  */
+  reap_children (0, 0);
+
+  /* Chop the commands up into lines if they aren't already.  */
+  chop_commands (cmds);
+
+  /* Start the command sequence, record it in a new
+     'struct child', and add that to the chain.  */
+
+  c = xcalloc (sizeof (struct child));
+  output_init (&c->output);
+
+  c->file = file;
+  c->sh_batch_file = NULL;
+
+  /* Cache dontcare flag because file->dontcare can be changed once we
+     return. Check dontcare inheritance mechanism for details.  */
+  c->dontcare = file->dontcare;
+
+  /* Start saving output in case the expansion uses $(info ...) etc.  */
+  OUTPUT_SET (&c->output);
+
+  /* Expand the command lines.  */
+  c->command_lines = expand_command_lines (file);
 
   /* Fetch the first command line to be run.  */
   job_next_command (c);
@@ -118,6 +118,7 @@ extern struct child *children;
 /* A signal handler for SIGCHLD, if needed.  */
 void child_handler (int sig);
 int is_bourne_compatible_shell(const char *path);
+char **expand_command_lines (struct file *file);
 void new_job (struct file *file);
 void reap_children (int block, int err);
 void start_waiting_jobs (void);
@@ -216,6 +216,15 @@ static const int default_keep_going_flag = 0;
 
 int check_symlink_flag = 0;
 
+/* Nonzero means don't use the timestamps recorded in the state file.  */
+
+int full_check_flag = 0;
+
+/* The sockets given with --server and --client, or null.  */
+
+static char *server_socket = 0;
+static char *client_socket = 0;
+
 /* Nonzero means print directory before starting and when done (-w).  */
 
 int print_directory_flag = 0;
@@ -335,6 +344,8 @@ static const char *const usage[] =
   -C DIRECTORY, --directory=DIRECTORY\n\
                               Change to DIRECTORY before doing anything.\n"),
     N_("\
+  --client[=SOCKET]           Have the make server on SOCKET do the work.\n"),
+    N_("\
   -d                          Print lots of debugging information.\n"),
     N_("\
   --debug[=FLAGS]             Print various types of debugging information.\n"),
@@ -347,6 +358,8 @@ static const char *const usage[] =
   -f FILE, --file=FILE, --makefile=FILE\n\
                               Read FILE as a makefile.\n"),
     N_("\
+  --full-check                Ignore the .STATE_FILE; stat() every file.\n"),
+    N_("\
   -h, --help                  Print this message and exit.\n"),
     N_("\
   -i, --ignore-errors         Ignore errors from recipes.\n"),
@@ -385,6 +398,8 @@ static const char *const usage[] =
   -S, --no-keep-going, --stop\n\
                               Turns off -k.\n"),
     N_("\
+  --server[=SOCKET]           Serve requests from make --client on SOCKET.\n"),
+    N_("\
   -t, --touch                 Touch targets instead of remaking them.\n"),
     N_("\
   --trace                     Print tracing information.\n"),
@@ -455,6 +470,9 @@ static const struct command_switch switches[] =
     { CHAR_MAX+6, flag, &trace_flag, 1, 1, 0, 0, 0, "trace" },
     { CHAR_MAX+7, flag, &warn_undefined_variables_flag, 1, 1, 0, 0, &default_warn_undef_vars, "warn-undefined-macros" },
     { CHAR_MAX+8, flag_off, &warn_undefined_variables_flag, 1, 1, 0, 0, &default_warn_undef_vars, "no-warn-undefined-macros" },
+    { CHAR_MAX+9, flag, &full_check_flag, 1, 1, 0, 0, 0, "full-check" },
+    { CHAR_MAX+10, string, &server_socket, 0, 0, 0, ".make.sock", 0, "server" },
+    { CHAR_MAX+11, string, &client_socket, 0, 0, 0, ".make.sock", 0, "client" },
     { 0, 0, 0, 0, 0, 0, 0, 0, 0 }
   };
 
@@ -1341,6 +1359,9 @@ main (int argc, char **argv, char **envp)
 #endif
 #ifdef MAKE_LOAD
                            " load"
+#endif
+#ifdef MAKE_SERVER
+                           " server"
 #endif
                            ;
 
@@ -1807,6 +1828,10 @@ main (int argc, char **argv, char **envp)
 
   define_variable_cname ("CURDIR", current_directory, o_file, 0);
 
+  /* If a make server can update the goals for us, let it.  */
+  if (client_socket != 0)
+    run_client (client_socket, current_directory, argc, argv, environ);
+
   /* Read any stdin makefiles into temporary files.  */
 
   if (makefiles != 0)
@@ -1986,6 +2011,14 @@ main (int argc, char **argv, char **envp)
       define_variable_cname ("-*-eval-flags-*-", value, o_automatic, 0);
     }
 
+  if (server_socket != 0)
+    {
+      if (stdin_nm != 0)
+        O (fatal, NILF,
+           _("--server cannot read makefiles from standard input"));
+      prepare_server (server_socket, argc, argv, environ);
+    }
+
   /* Read all the makefiles.  */
 
   read_files = read_all_makefiles (makefiles == 0 ? 0 : makefiles->list);
@@ -2588,10 +2621,17 @@ main (int argc, char **argv, char **envp)
       O (fatal, NILF, _("No targets"));
     }
 
+  /* A make server updates the goals when asked to.  */
+  if (server_socket != 0)
+    serve (goals, read_files, makefile_status, current_directory);
+
   /* Update the goals.  */
 
   DB (DB_BASIC, (_("Updating goal targets....\n")));
 
+  load_state ();
+  prefetch_mtimes (goals);
+
   {
     switch (update_goal_chain (goals))
     {
@@ -2616,6 +2656,8 @@ main (int argc, char **argv, char **envp)
       O (error, NILF,
          _("warning:  Clock skew detected.  Your build may be incomplete."));
 
+    save_state ();
+
     /* Exit.  */
     die (makefile_status);
   }
@@ -3556,6 +3598,9 @@ die (int status)
 #ifdef WINDOWS32
       delete_susp_main_event ();
 #endif
+
+      /* A make server starts over if it was serving a client.  */
+      server_exit (status);
     }
 
   exit (status);
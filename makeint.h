@@ -522,6 +522,29 @@ void *xcalloc (size_t);
 void *xrealloc (void *, size_t);
 char *xstrdup (const char *);
 char *xstrndup (const char *, size_t);
+
+/* A bump-pointer allocator for many objects of one size, which are rarely
+   (or never) freed individually.  Freed objects go onto a free list and are
+   handed out again before new space is taken from the current block.  */
+struct arena
+  {
+    const char *name;           /* Name for the statistics.  */
+    size_t size;                /* Size of each object (rounded up).  */
+    char *next;                 /* Next free object in the current block.  */
+    char *end;                  /* End of the current block.  */
+    void *free_list;            /* Chain of freed objects.  */
+    unsigned long blocks;       /* Number of blocks allocated.  */
+    unsigned long allocs;       /* Number of objects handed out.  */
+    unsigned long frees;        /* Number of objects returned.  */
+  };
+
+#define ARENA_INIT(_n, _t)  { (_n), sizeof (_t), NULL, NULL, NULL, 0, 0, 0 }
+
+void *arena_alloc (struct arena *);
+void *arena_alloc_array (struct arena *, size_t);
+void arena_free (struct arena *, void *);
+void arena_print_stats (const struct arena *, const char *);
+
 char *find_next_token (const char **, size_t *);
 char *find_next_token_path (const char **, size_t *);
 char *next_token (const char *);
@@ -553,12 +576,30 @@ int ar_member_touch (const char *arname, const char *memname);
 #endif
 
 int dir_file_exists_p (const char *, const char *);
+int dir_file_listed (const char *, const char *);
+extern unsigned long dir_generation;
+int dir_map_files (const char *, void (*) (const char *, void *), void *);
+int dir_extension_p (const char *, const char *);
+extern unsigned long dir_extension_generation;
 int file_exists_p (const char *);
 int file_impossible_p (const char *);
 void file_impossible (const char *);
 const char *dir_name (const char *);
+int dir_fd (const char *, const char **);
+int dir_stat (const char *, struct stat *);
+void close_directory_fds (void);
 void print_dir_data_base (void);
 void dir_setup_glob (glob_t *);
+#ifdef MAKE_SERVER
+#define DIR_QUERY_PARSE 1
+#define DIR_QUERY_BUILD 2
+extern int dir_record_queries;
+void map_directories (void (*) (const char *, int, void *), void *);
+int dir_file_known (const char *, const char *);
+int dir_file_queried (const char *, const char *);
+void dir_file_changed (const char *, const char *, int);
+int dir_contents_changed (const char *);
+#endif
 void hash_init_directories (void);
 
 const char *read_config (const char *path, int exclusive, const char *argv0);
@@ -575,6 +616,10 @@ void construct_vpath_list (char *pattern, char *dirpath, int target_path);
 const char *vpath_search (const char *file, FILE_TIMESTAMP *mtime_ptr, int *target_path,
                           unsigned int* vpath_index, unsigned int* path_index);
 int gpath_search (const char *file, unsigned int len);
+void vpath_note_file (const char *name);
+int vpath_extension_p (const char *dir, size_t dirlen, const char *ext);
+int vpath_defined_p (void);
+extern unsigned long vpath_generation;
 
 void construct_include_path (const char **arg_dirs);
 
@@ -592,6 +637,8 @@ void strcache_print_stats (const char *prefix);
 int strcache_iscached (const char *str);
 const char *strcache_add (const char *str);
 const char *strcache_add_len (const char *str, size_t len);
+size_t strcache_get_len (const char *str);
+unsigned long strcache_get_hash (const char *str);
 
 /* Guile support  */
 int guile_gmake_setup (const floc *flocp);
@@ -601,6 +648,13 @@ typedef int (*load_func_t)(const floc *flocp);
 int load_file (const floc *flocp, const char **filename, int noerror);
 int unload_file (const char *name);
 
+/* Resident server: server.c  */
+void prepare_server (const char *name, int argc, char **argv, char **envp);
+void run_client (const char *name, const char *cwd, int argc, char **argv,
+                 char **envp);
+void server_exit (int status);
+void server_signal (int sig);
+
 /* We omit these declarations on non-POSIX systems which define _POSIX_VERSION,
    because such systems often declare them in header files anyway.  */
 
@@ -661,6 +715,7 @@ extern int just_print_flag, silent_flag, ignore_errors_flag, keep_going_flag;
 extern int print_data_base_flag, question_flag, touch_flag, always_make_flag;
 extern int env_overrides, no_builtin_rules_flag, no_builtin_variables_flag;
 extern int print_version_flag, print_directory_flag, check_symlink_flag;
+extern int full_check_flag;
 extern int warn_undefined_variables_flag, trace_flag, posix_pedantic;
 extern int not_parallel, second_expansion, clock_skew_detected;
 extern int rebuilding_makefiles, one_shell, output_sync, verify_flag;
@@ -727,6 +782,7 @@ void print_variable_data_base (void);
 void print_vpath_data_base (void);
 
 extern char *starting_directory;
+extern char *directory_before_chdir;
 extern unsigned int makelevel;
 extern char *version_string, *remote_description, *make_host;
 
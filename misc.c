@@ -313,6 +313,101 @@ xstrndup (const char *str, size_t length)
 }
 
 
+/* Objects are taken from blocks of this size, and aligned on this size.  */
+
+#define ARENA_BLOCK_SIZE        (64 * 1024 - 2 * sizeof (size_t))
+#define ARENA_ALIGN             (sizeof (uintmax_t) > sizeof (void *) \
+                                 ? sizeof (uintmax_t) : sizeof (void *))
+
+/* Take COUNT consecutive objects from the current block of arena A,
+   starting a new block if they don't fit.  The objects left over at the
+   end of the old block go on the free list.  */
+
+static char *
+arena_bump (struct arena *a, size_t count)
+{
+  char *result;
+
+  if (a->blocks == 0)
+    /* First use: round the object size up to the alignment.  */
+    a->size = (a->size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+  if (a->next == NULL || a->next + count * a->size > a->end)
+    {
+      size_t n = ARENA_BLOCK_SIZE / a->size;
+      if (n < count)
+        n = count;
+      for (; a->next != NULL && a->next < a->end; a->next += a->size)
+        {
+          *(void **) a->next = a->free_list;
+          a->free_list = a->next;
+        }
+      a->next = xmalloc (n * a->size);
+      a->end = a->next + n * a->size;
+      ++a->blocks;
+    }
+
+  result = a->next;
+  a->next += count * a->size;
+  return result;
+}
+
+/* Return a zero-filled object from arena A.  */
+
+void *
+arena_alloc (struct arena *a)
+{
+  void *result;
+
+  if (a->free_list != NULL)
+    {
+      result = a->free_list;
+      a->free_list = *(void **) result;
+    }
+  else
+    result = arena_bump (a, 1);
+
+  ++a->allocs;
+  memset (result, '\0', a->size);
+  return result;
+}
+
+/* Return COUNT zero-filled objects from arena A that are adjacent in
+   memory.  Each of them may be passed to arena_free() on its own.  */
+
+void *
+arena_alloc_array (struct arena *a, size_t count)
+{
+  char *result = arena_bump (a, count);
+
+  a->allocs += count;
+  memset (result, '\0', count * a->size);
+  return result;
+}
+
+/* Return object P to arena A, so that it can be handed out again.  */
+
+void
+arena_free (struct arena *a, void *p)
+{
+  if (p == NULL)
+    return;
+
+  *(void **) p = a->free_list;
+  a->free_list = p;
+  ++a->frees;
+}
+
+void
+arena_print_stats (const struct arena *a, const char *prefix)
+{
+  printf (_("%s %s arena: objects = %lu (%lu freed) / size = %lu B"
+            " / blocks = %lu\n"),
+          prefix, a->name, a->allocs, a->frees, (unsigned long) a->size,
+          a->blocks);
+}
+
+
 /* Limited INDEX:
    Search through the string STRING, which ends at LIMIT, for the character C.
    Returns a pointer to the first occurrence, or nil if none is found.
@@ -404,27 +499,52 @@ find_next_token_path (const char **ptr, size_t *lengthptr)
 struct dep *
 copy_dep_chain (const struct dep *d)
 {
-  struct dep *firstnew = 0;
-  struct dep *lastnew = 0;
+  return relocate_dep_chain (d, 1);
+}
+
+/* Copy the chain of 'struct dep' starting at D into a single run of adjacent
+   objects in the dep arena, so that walking the chain is a sequential scan
+   of memory.  The elements stay linked through 'next', and each may still
+   be freed on its own.  If COPY is zero, the old elements are freed (the
+   names of 2nd expansion deps move to the new chain), and a chain that is
+   laid out that way already is returned as it is; otherwise they are left
+   alone and the names of 2nd expansion deps are duplicated.  */
+
+struct dep *
+relocate_dep_chain (const struct dep *d, int copy)
+{
+  const struct dep *p;
+  struct dep *new, *c;
+  size_t count = 0;
+  int scattered = 0;
 
-  while (d != 0)
+  for (p = d; p != 0; p = p->next)
     {
-      struct dep *c = xmalloc (sizeof (struct dep));
-      memcpy (c, d, sizeof (struct dep));
+      ++count;
+      if (p->next != 0 && p->next != p + 1)
+        scattered = 1;
+    }
+  if (count == 0)
+    return 0;
+  if (!copy && !scattered)
+    return (struct dep *) d;
 
-      if (c->need_2nd_expansion)
-        c->name = xstrdup (c->name);
+  new = arena_alloc_array (&dep_arena, count);
+  for (c = new; d != 0; ++c)
+    {
+      const struct dep *next = d->next;
 
-      c->next = 0;
-      if (firstnew == 0)
-        firstnew = lastnew = c;
-      else
-        lastnew = lastnew->next = c;
+      memcpy (c, d, sizeof (struct dep));
+      if (copy && c->need_2nd_expansion)
+        c->name = xstrdup (c->name);
+      c->next = next ? c + 1 : 0;
 
-      d = d->next;
+      if (!copy)
+        free_dep ((struct dep *) d);
+      d = next;
     }
 
-  return firstnew;
+  return new;
 }
 
 /* Free a chain of struct nameseq.
@@ -440,6 +560,26 @@ free_ns_chain (struct nameseq *ns)
       free_ns (t);
     }
 }
+
+/* Free a chain of struct goaldep.  */
+
+void
+free_goaldep_chain (struct goaldep *g)
+{
+  while (g != 0)
+    {
+      struct goaldep *t = g;
+      g = g->next;
+      free_goaldep (t);
+    }
+}
+
+/* Arenas for the elements of the dependency graph.  A struct nameseq is the
+   leading part of a struct dep, and the two are freed through the same
+   functions, so they share an arena.  */
+
+struct arena dep_arena = ARENA_INIT ("dep", struct dep);
+struct arena goaldep_arena = ARENA_INIT ("goaldep", struct goaldep);
 
 
 #if !HAVE_STRCASECMP && !HAVE_STRICMP && !HAVE_STRCMPI
@@ -1951,6 +1951,40 @@ conditional_line (char *line, int len, const floc *flocp)
   return 0;
 }
 
+/* Return nonzero if the target-specific variable definition DEFN gives
+   the same variable to every target whose variables are SET: nothing in it
+   is expanded when it is defined, or what is expanded has no references.  */
+
+static int
+shareable_target_var (const char *defn, const struct variable_set *set)
+{
+  struct variable var;
+
+  if (!parse_variable_definition (defn, &var)
+      || memchr (var.name, '$', var.length) != 0)
+    return 0;
+
+  switch (var.flavor)
+    {
+    case f_recursive:
+    case f_conditional:
+      return 1;
+    case f_append:
+      {
+        const struct variable *v;
+        v = lookup_variable_in_set (var.name, var.length, set);
+        if (v == 0 || v->recursive)
+          return 1;
+      }
+      /* FALLTHROUGH */
+    case f_simple:
+    case f_expand:
+      return strchr (var.value, '$') == 0;
+    default:
+      return 0;
+    }
+}
+
 /* Record target-specific variable values for files FILENAMES.
    TWO_COLON is nonzero if a double colon was used.
 
@@ -1967,6 +2001,10 @@ record_target_var (struct nameseq *filenames, char *defn,
 {
   struct nameseq *nextf;
   struct variable_set_list *global;
+  struct variable_set *from = 0;
+  struct variable_set *to = 0;
+  struct variable_set_list *from_next = 0;
+  int share;
 
   global = current_variable_set_list;
 
@@ -2018,11 +2056,40 @@ record_target_var (struct nameseq *filenames, char *defn,
 
           initialize_file_variables (f, 1);
 
+          /* A target whose variables were the same as those of the one
+             before it on this line gets the same variables, unless the
+             definition expands something.  */
+          if (to != 0 && f->variables->set == from
+              && f->variables->next == from_next)
+            {
+              share_variable_set (f->variables, to);
+              continue;
+            }
+
+          if (to != 0)
+            {
+              release_variable_set (from);
+              release_variable_set (to);
+              to = 0;
+            }
+          from = f->variables->set;
+          from_next = f->variables->next;
+          share = shareable_target_var (defn, from);
+
+          unshare_variable_set (f->variables);
           current_variable_set_list = f->variables;
           v = try_variable_definition (flocp, defn, origin, 1);
           if (!v)
             O (fatal, flocp, _("Malformed target-specific variable definition"));
           current_variable_set_list = global;
+
+          /* Keep both sets while the next targets may use them.  */
+          if (share && f->variables->set != from)
+            {
+              to = f->variables->set;
+              ++from->shared;
+              ++to->shared;
+            }
         }
 
       /* Set up the variable to be *-specific.  */
@@ -2043,12 +2110,19 @@ record_target_var (struct nameseq *filenames, char *defn,
             {
               free (v->value);
               v->value = xstrdup (gv->value);
+              v->value_size = 0;
               v->origin = gv->origin;
               v->recursive = gv->recursive;
               v->append = 0;
             }
         }
     }
+
+  if (to != 0)
+    {
+      release_variable_set (from);
+      release_variable_set (to);
+    }
 }
 
 /* Record a description line for files FILENAMES,
@@ -2073,6 +2147,8 @@ record_files (struct nameseq *filenames, const char *pattern,
   struct dep *deps;
   const char *implicit_percent;
   const char *name;
+  int share;
+  int shared = 0;
 
   /* If we've already snapped deps, that means we're in an eval being
      resolved after the makefiles have been read in.  We can't add more rules
@@ -2177,6 +2253,11 @@ record_files (struct nameseq *filenames, const char *pattern,
     }
 
 
+  /* The targets of a rule share plain prerequisites; static pattern rules
+     give each its own stem, and second expansion its own list.  */
+  share = (deps != 0 && filenames->next != 0 && !pattern
+           && !deps->need_2nd_expansion);
+
   /* Walk through each target and create it in the database.
      We already set up the first target, above.  */
   while (1)
@@ -2206,8 +2287,8 @@ record_files (struct nameseq *filenames, const char *pattern,
       else if (deps)
         /* If there are multiple targets, copy the chain DEPS for all but the
            last one.  It is not safe for the same deps to go in more than one
-           place in the database.  */
-        this = nextf != 0 ? copy_dep_chain (deps) : deps;
+           place in the database, unless they are shared; see below.  */
+        this = nextf != 0 && !share ? copy_dep_chain (deps) : deps;
 
       /* Find or create an entry in the file database for this target.  */
       if (!two_colon)
@@ -2250,8 +2331,10 @@ record_files (struct nameseq *filenames, const char *pattern,
              suffixes.  */
           if (f == suffix_file && this == 0)
             {
-              free_dep_chain (f->deps);
+              if (!f->deps_shared)
+                free_dep_chain (f->deps);
               f->deps = 0;
+              f->deps_shared = 0;
             }
         }
       else
@@ -2299,10 +2382,26 @@ record_files (struct nameseq *filenames, const char *pattern,
             }
         }
 
+      /* A target that has no prerequisites yet shares DEPS with the other
+         targets of the rule.  Others need a copy, unless DEPS is not shared
+         and this is the last target.  */
+      if (this != 0 && share)
+        {
+          if (f->deps == 0)
+            {
+              share_deps (f, deps, !shared);
+              shared = 1;
+              this = 0;
+            }
+          else if (nextf != 0 || shared)
+            this = copy_dep_chain (deps);
+        }
+
       /* Add the dependencies to this file entry.  */
       if (this != 0)
         {
           /* Add the file's old deps and the new ones in THIS together.  */
+          unshare_deps (f);
           if (f->deps == 0)
             f->deps = this;
           else if (cmds != 0)
@@ -3159,7 +3258,7 @@ parse_file_seq (char **stringp, size_t size, int stopmap,
   struct nameseq *new = 0;
   struct nameseq **newp = &new;
 #define NEWELT(_n)  do { \
-                        struct nameseq *_ns = xcalloc (size);       \
+                        struct nameseq *_ns = alloc_ns ();          \
                         const char *__n = (_n);                     \
                         _ns->name = (cachep ? strcache_add (__n) : xstrdup (__n)); \
                         if (found_wait) {                           \
@@ -3178,8 +3277,8 @@ parse_file_seq (char **stringp, size_t size, int stopmap,
   /* Always stop on NUL.  */
   stopmap |= MAP_NUL;
 
-  if (size < sizeof (struct nameseq))
-    size = sizeof (struct nameseq);
+  /* Elements come from the dep arena, which has room for a struct dep.  */
+  assert (size <= sizeof (struct dep));
 
   if (NONE_SET (flags, PARSEFS_NOGLOB))
     dir_setup_glob (&gl);
@@ -36,6 +36,9 @@ this program.  If not, see <https://www.gnu.org/licenses/>.  */
 #ifdef WINDOWS32
 #include <io.h>
 #endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 
 /* The test for circular dependencies is based on the 'updating' bit in
@@ -234,7 +237,7 @@ update_goal_chain (struct goaldep *goaldeps)
                 lastgoal->next = g->next;
 
               /* Free the storage.  */
-              free (g);
+              free_dep (g);
 
               g = lastgoal == 0 ? goals : lastgoal->next;
 
@@ -425,6 +428,48 @@ complain (struct file *file)
     }
 }
 
+/* Return nonzero if every file in the prerequisite set S has been found up
+   to date on the current pass over the goal chain: it was updated
+   successfully, it exists, and it is not an intermediate or double-colon
+   file (check_dep() treats those specially).  Then S->max_mtime is the
+   newest modtime of the files.  The answer is remembered for the rest of
+   the pass, unless some file has just not been considered yet.  */
+
+static int
+depset_settled (struct depset *s)
+{
+  FILE_TIMESTAMP max_mtime = 0;
+  unsigned int i;
+
+  if (s->checked == considered)
+    return s->settled;
+
+  s->settled = 0;
+  for (i = 0; i < s->count; ++i)
+    {
+      const struct file *f = s->files[i];
+
+      if (f->renamed || f->double_colon || f->intermediate || f->phony)
+        break;
+      if (f->command_state != cs_finished)
+        return 0;
+      if (f->update_status != us_success
+          || f->last_mtime == UNKNOWN_MTIME
+          || f->last_mtime == NONEXISTENT_MTIME)
+        break;
+      if (f->last_mtime > max_mtime)
+        max_mtime = f->last_mtime;
+    }
+
+  s->checked = considered;
+  if (i == s->count)
+    {
+      s->settled = 1;
+      s->max_mtime = max_mtime;
+    }
+  return s->settled;
+}
+
 /* Consider a single 'struct file' and update it as appropriate.
    Return 0 on success, or non-0 on failure.  */
 
@@ -438,6 +483,7 @@ update_file_1 (struct file *file, unsigned int depth)
   struct dep *d, *ad;
   struct dep amake;
   int running = 0;
+  int skip_deps;
 
   DBF (DB_VERBOSE, _("Considering target file '%s'.\n"));
 
@@ -533,6 +579,20 @@ update_file_1 (struct file *file, unsigned int depth)
       file->cmds = default_file->cmds;
     }
 
+  /* If our prerequisites end with an interned set whose files have all been
+     found up to date on this pass already, and this file is newer than all
+     of them, then checking them again would neither make anything nor mark
+     any of them as changed: the loops below stop where the set starts.  Only
+     do this when we see this file for the first time, so no 'changed' flag
+     can be left over from an earlier pass.  */
+  skip_deps = (file->depset != 0 && !noexist
+               && file->command_state == cs_not_started
+               && !file->double_colon && !file->intermediate
+               && !rebuilding_makefiles && !always_make_flag
+               && !ISDB (DB_VERBOSE)
+               && depset_settled (file->depset)
+               && file->depset->max_mtime <= this_mtime);
+
   /* Update all non-intermediate files we depend on, if necessary, and see
      whether any of them is more recent than this file.  We need to walk our
      deps, AND the deps of any also_make targets to ensure everything happens
@@ -544,9 +604,10 @@ update_file_1 (struct file *file, unsigned int depth)
   while (ad)
     {
       struct dep *lastd = 0;
+      struct file *df = ad->file;
 
       /* Find the deps we're scanning */
-      d = ad->file->deps;
+      d = df->deps;
       ad = ad->next;
 
       while (d)
@@ -559,6 +620,9 @@ update_file_1 (struct file *file, unsigned int depth)
           if (d->wait_here && running)
             break;
 
+          if (d->depset_start && skip_deps && df == file)
+            break;
+
           check_renamed (d->file);
 
           mtime = file_mtime (d->file);
@@ -572,6 +636,7 @@ update_file_1 (struct file *file, unsigned int depth)
               /* We cannot free D here because our the caller will still have
                  a reference to it when we were called recursively via
                  check_dep below.  */
+              file->depset = df->depset = 0;
               if (lastd == 0)
                 file->deps = d->next;
               else
@@ -640,6 +705,9 @@ update_file_1 (struct file *file, unsigned int depth)
           if (d->wait_here && running)
             break;
 
+          if (d->depset_start && skip_deps)
+            break;
+
           if (d->file->intermediate)
             {
               enum update_status new;
@@ -744,7 +812,12 @@ update_file_1 (struct file *file, unsigned int depth)
   deps_changed = 0;
   for (d = file->deps; d != 0; d = d->next)
     {
-      FILE_TIMESTAMP d_mtime = file_mtime (d->file);
+      FILE_TIMESTAMP d_mtime;
+
+      if (d->depset_start && skip_deps)
+        break;
+
+      d_mtime = file_mtime (d->file);
       check_renamed (d->file);
 
       if (! d->ignore_mtime)
@@ -819,6 +892,30 @@ update_file_1 (struct file *file, unsigned int depth)
       must_make = 1;
       DBF (DB_VERBOSE, _("Making '%s' due to always-make flag.\n"));
     }
+  else if (must_make && !noexist && !always_make_flag
+           && hash_unchanged (file))
+    {
+      must_make = 0;
+      DBF (DB_BASIC,
+           _("Prerequisites of '%s' are newer but have not changed.\n"));
+    }
+  else if (must_make && !noexist && !always_make_flag
+           && restat_unchanged (file))
+    {
+      must_make = 0;
+      DBF (DB_BASIC,
+           _("Recipe of '%s' has run since its prerequisites changed.\n"));
+    }
+
+  /* A .CMDCHECK target whose recipe changed is out of date.  The recipe
+     is looked at even if the target is to be remade anyway, so that it
+     can be recorded once it has run; looking at it runs no functions with
+     side effects.  */
+  if (file->cmds != 0 && !file->phony && recipe_changed (file) && !must_make)
+    {
+      must_make = 1;
+      DBF (DB_BASIC, _("Recipe of '%s' has changed.\n"));
+    }
 
   if (!must_make)
     {
@@ -969,6 +1066,14 @@ notice_finished_file (struct file *file)
       file->last_mtime = i == 0 ? UNKNOWN_MTIME : NEW_MTIME;
     }
 
+  /* A .RESTAT target that its recipe left as it was keeps its old time.  */
+  if (ran)
+    finish_restat (file);
+
+  /* Record the recipe that made a .CMDCHECK target.  */
+  if (ran || touched)
+    finish_recipe (file);
+
   if (file->double_colon)
     {
       /* If this is a double colon rule and it is the last one to be
@@ -1113,6 +1218,7 @@ check_dep (struct file *file, unsigned int depth,
                 {
                   OSS (error, NILF, _("Circular %s <- %s dependency dropped."),
                        file->name, d->file->name);
+                  file->depset = 0;
                   if (ld == 0)
                     {
                       file->deps = d->next;
@@ -1254,9 +1360,20 @@ remake_file (struct file *file)
     {
       chop_commands (file->cmds);
 
+      /* Files may change from now on, so stop trusting the timestamps
+         collected in advance, the directory descriptors and the state
+         file.  With -n, -q or -t only recursive lines are run, and a state
+         file that nothing else changes must be left as it is.  */
+      discard_prefetched_mtimes ();
+      close_directory_fds ();
+      if (!(just_print_flag || question_flag || touch_flag)
+          || file->cmds->any_recurse)
+        invalidate_state ();
+
       /* The normal case: start some commands.  */
       if (!touch_flag || file->cmds->any_recurse)
         {
+          start_restat (file);
           execute_file_commands (file);
           return;
         }
@@ -1269,6 +1386,294 @@ remake_file (struct file *file)
   notice_finished_file (file);
 }
 
+#ifdef HAVE_PTHREAD
+
+/* Collecting timestamps in advance.  On a null build most of the time can
+   go to stat()ing each file as update_file() reaches it, one at a time,
+   especially with cold caches or on a network file system.  So before the
+   goals are updated, prefetch_mtimes() finds the files reachable from them
+   whose timestamps are not known yet and stat()s them all with a pool of
+   threads.  The results are kept in a table, keyed by the (strcache'd)
+   name, that f_mtime() consults before calling name_mtime().  Each result
+   is used at most once, and the table is discarded as soon as a recipe is
+   started, since from then on the files may change.  The threads only ever
+   call stat(); everything else is done by the main thread after they are
+   joined.  */
+
+/* Don't bother starting threads for fewer files than this.  */
+#define PREFETCH_MIN    64
+
+/* Number of threads, including the main one.  These spend their time
+   waiting for the file system, so there may be more of them than CPUs.  */
+#define PREFETCH_THREADS 8
+
+/* Number of files a thread takes from the queue at once.  */
+#define PREFETCH_CHUNK  32
+
+struct mtime_fetch
+  {
+    const char *name;
+    const char *base;           /* NAME relative to FD, from dir_fd().  */
+    int fd;
+    time_t sec;                 /* Modtime, if ERR is zero.  */
+    long int ns;
+    int err;                    /* errno from stat(), or zero.  */
+  };
+
+static struct mtime_fetch *fetches;
+static unsigned int fetch_count;
+static unsigned int fetch_next;
+static pthread_mutex_t fetch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct hash_table prefetched;
+static int have_prefetched = 0;
+
+static unsigned long
+fetch_hash_1 (const void *key)
+{
+  unsigned long result = 0;
+  ADDRESS_HASH_1 (((struct mtime_fetch const *) key)->name, result);
+  return result;
+}
+
+static unsigned long
+fetch_hash_2 (const void *key)
+{
+  unsigned long result = 0;
+  ADDRESS_HASH_2 (((struct mtime_fetch const *) key)->name, result);
+  return result;
+}
+
+static int
+fetch_hash_cmp (const void *x, const void *y)
+{
+  int result;
+  ADDRESS_COMPARE (((struct mtime_fetch const *) x)->name,
+                   ((struct mtime_fetch const *) y)->name, result);
+  return result;
+}
+
+/* Thread body: stat() files from the queue until it is empty.  The
+   directory descriptors were all looked up by the main thread.  */
+
+static void *
+fetch_mtimes (void *arg UNUSED)
+{
+  while (1)
+    {
+      unsigned int i, end;
+
+      pthread_mutex_lock (&fetch_lock);
+      i = fetch_next;
+      end = i + PREFETCH_CHUNK < fetch_count ? i + PREFETCH_CHUNK : fetch_count;
+      fetch_next = end;
+      pthread_mutex_unlock (&fetch_lock);
+
+      if (i == end)
+        return 0;
+
+      for (; i < end; ++i)
+        {
+          struct mtime_fetch *mf = &fetches[i];
+          struct stat st;
+          int e;
+
+#ifdef HAVE_FSTATAT
+          if (mf->base != mf->name)
+            EINTRLOOP (e, fstatat (mf->fd, mf->base, &st, 0));
+          else
+#endif
+            EINTRLOOP (e, stat (mf->name, &st));
+          if (e != 0)
+            mf->err = errno;
+          else
+            {
+              mf->err = 0;
+              mf->sec = st.st_mtime;
+#if FILE_TIMESTAMP_HI_RES
+              mf->ns = st.ST_MTIM_NSEC;
+#else
+              mf->ns = 0;
+#endif
+            }
+        }
+    }
+}
+
+/* Add FILE to the queue, if its timestamp will be needed and is not known.
+   Archive members are left to ar_member_date().  */
+
+static void
+queue_mtime_fetch (struct file *file, unsigned int *size)
+{
+  FILE_TIMESTAMP mtime;
+
+  if (file->last_mtime != UNKNOWN_MTIME || file->renamed
+      || state_mtime (file, &mtime)
+#ifndef NO_ARCHIVES
+      || ar_name (file->name)
+#endif
+      )
+    return;
+
+  if (fetch_count == *size)
+    {
+      *size = *size ? *size * 2 : 1024;
+      fetches = xrealloc (fetches, *size * sizeof (struct mtime_fetch));
+    }
+  fetches[fetch_count].name = file->name;
+  fetches[fetch_count].fd = dir_fd (file->name, &fetches[fetch_count].base);
+  ++fetch_count;
+}
+
+/* Collect the timestamps of the files reachable from GOALS.  With -L the
+   symlinks have to be looked at too, so leave it all to name_mtime().  */
+
+void
+prefetch_mtimes (struct goaldep *goals)
+{
+  pthread_t threads[PREFETCH_THREADS - 1];
+  unsigned int nthreads = 0;
+  struct file **stack = 0;
+  unsigned int depth = 0, stack_size = 0, size = 0;
+  sigset_t all, old;
+  unsigned int i;
+
+  /* Don't trust anything a previous call collected (a make server calls
+     this for each request).  */
+  discard_prefetched_mtimes ();
+
+  if (check_symlink_flag)
+    return;
+
+  /* Walk the graph depth-first, marking each file as it is pushed.  */
+#define PUSH(_f)                                                        \
+  do {                                                                  \
+    struct file *_p = (_f);                                             \
+    if (!_p->mtime_queued)                                              \
+      {                                                                 \
+        _p->mtime_queued = 1;                                           \
+        if (depth == stack_size)                                        \
+          {                                                             \
+            stack_size = stack_size ? stack_size * 2 : 256;             \
+            stack = xrealloc (stack, stack_size * sizeof (struct file *)); \
+          }                                                             \
+        stack[depth++] = _p;                                            \
+      }                                                                 \
+  } while (0)
+
+  fetch_count = fetch_next = 0;
+  for (; goals != 0; goals = goals->next)
+    PUSH (goals->file);
+
+  while (depth > 0)
+    {
+      struct file *f = stack[--depth];
+      struct dep *d;
+
+      if (f->renamed)
+        PUSH (f->renamed);
+      queue_mtime_fetch (f, &size);
+
+      for (d = f->also_make; d != 0; d = d->next)
+        PUSH (d->file);
+      for (f = f->double_colon ? f->double_colon : f; f != 0; f = f->prev)
+        for (d = f->deps; d != 0; d = d->next)
+          PUSH (d->file);
+    }
+#undef PUSH
+
+  free (stack);
+
+  if (fetch_count < PREFETCH_MIN)
+    {
+      free (fetches);
+      fetches = 0;
+      return;
+    }
+
+  /* The threads must not take any of our signals.  */
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &old);
+  while (nthreads < PREFETCH_THREADS - 1
+         && pthread_create (&threads[nthreads], 0, fetch_mtimes, 0) == 0)
+    ++nthreads;
+  pthread_sigmask (SIG_SETMASK, &old, 0);
+
+  fetch_mtimes (0);
+  for (i = 0; i < nthreads; ++i)
+    pthread_join (threads[i], 0);
+
+  /* Only keep the answers name_mtime() would accept from stat().  */
+  hash_init (&prefetched, fetch_count, fetch_hash_1, fetch_hash_2,
+             fetch_hash_cmp);
+  for (i = 0; i < fetch_count; ++i)
+    if (fetches[i].err == 0 || fetches[i].err == ENOENT
+        || fetches[i].err == ENOTDIR)
+      hash_insert (&prefetched, &fetches[i]);
+  have_prefetched = 1;
+
+  DB (DB_VERBOSE, (_("Collected %u file timestamps using %u threads.\n"),
+                   fetch_count, nthreads + 1));
+}
+
+/* If the timestamp of NAME, a file name from the strcache, was collected
+   in advance, store it in *MTIME, forget it and return nonzero.  */
+
+static int
+prefetched_mtime (const char *name, FILE_TIMESTAMP *mtime)
+{
+  struct mtime_fetch key;
+  struct mtime_fetch **slot;
+  struct mtime_fetch *mf;
+
+  if (!have_prefetched)
+    return 0;
+
+  key.name = name;
+  slot = (struct mtime_fetch **) hash_find_slot (&prefetched, &key);
+  mf = *slot;
+  if (HASH_VACANT (mf))
+    return 0;
+
+  hash_delete_at (&prefetched, slot);
+  if (mf->err != 0)
+    *mtime = NONEXISTENT_MTIME;
+  else
+    *mtime = file_timestamp_cons (name, mf->sec, mf->ns);
+  return 1;
+}
+
+/* Forget the timestamps collected in advance; the files may change.  */
+
+void
+discard_prefetched_mtimes (void)
+{
+  if (!have_prefetched)
+    return;
+
+  hash_free (&prefetched, 0);
+  free (fetches);
+  fetches = 0;
+  have_prefetched = 0;
+}
+
+#else /* !HAVE_PTHREAD */
+
+void
+prefetch_mtimes (struct goaldep *goals UNUSED)
+{
+}
+
+void
+discard_prefetched_mtimes (void)
+{
+}
+
+# define prefetched_mtime(_n, _m)       0
+
+#endif /* !HAVE_PTHREAD */
+
 /* Return the mtime of a file, given a 'struct file'.
    Caches the time in the struct file to avoid excess stat calls.
 
@@ -1347,7 +1752,10 @@ f_mtime (struct file *file, int search)
   else
 #endif
     {
-      mtime = name_mtime (file->name);
+      if (!state_mtime (file, &mtime)
+          && !prefetched_mtime (file->name, &mtime))
+        mtime = name_mtime (file->name);
+      mtime = restat_mtime (file, mtime);
 
       if (mtime == NONEXISTENT_MTIME && search && !file->ignore_vpath)
         {
@@ -1379,15 +1787,15 @@ f_mtime (struct file *file, int search)
                  the dependencies are updated. */
               assert(name != NULL);
 #ifndef VMS
-              name_len = strlen (name) - strlen (file->name) - 1;
+              name_len = strcache_get_len (name) - strcache_get_len (file->name) - 1;
 #else
-              name_len = strlen (name) - strlen (file->name);
+              name_len = strcache_get_len (name) - strcache_get_len (file->name);
               if (name[name_len - 1] == '/')
                   name_len--;
 #endif
               if (target_path && !file->is_renamed) {
                   assert(file->vpath_orgname == NULL && file->name != NULL);
-                  file->vpath_orgname = xstrdup(file->name);    /* save the original target name (for pattern matching) */
+                  file->vpath_orgname = file->name;    /* save the original target name (for pattern matching) */
                   file->is_renamed = 1;
               }
               if (target_path || gpath_search (name, name_len))
@@ -1516,7 +1924,7 @@ name_mtime (const char *name)
   struct stat st;
   int e;
 
-  EINTRLOOP (e, stat (name, &st));
+  EINTRLOOP (e, dir_stat (name, &st));
   if (e == 0)
     mtime = FILE_TIMESTAMP_STAT_MODTIME (name, st);
   else if (errno == ENOENT || errno == ENOTDIR)
@@ -1739,6 +2147,15 @@ library_search (const char *lib, FILE_TIMESTAMP *mtime_ptr)
 
         for (dp = dirs; *dp != 0; ++dp)
           {
+            /* The directory cache rules out most of these without a
+               stat() each.  */
+            if (strchr (libbuf, '/') == 0
+                && dir_file_listed (*dp, libbuf) == 0)
+              {
+                vpath_index++;
+                continue;
+              }
+
             sprintf (buf, "%s/%s", *dp, libbuf);
             mtime = name_mtime (buf);
             if (mtime != NONEXISTENT_MTIME)
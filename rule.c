@@ -24,8 +24,10 @@ this program.  If not, see <https://www.gnu.org/licenses/>.  */
 #include "commands.h"
 #include "variable.h"
 #include "rule.h"
+#include "debug.h"
 
 static void freerule (struct rule *rule, struct rule *lastrule);
+static void invalidate_pattern_index (void);
 
 /* Chain of all pattern rules.  */
 
@@ -51,6 +53,12 @@ unsigned int max_pattern_deps;
 
 size_t max_pattern_dep_length;
 
+/* The terminal rules with a target that is just %, in order, and how many
+   there are.  */
+
+struct rule **anything_rules;
+unsigned int num_anything_rules;
+
 /* Pointer to structure for the file .SUFFIXES
    whose dependencies are the suffixes to be searched.  */
 
@@ -116,6 +124,106 @@ get_rule_defn (struct rule *r)
   return r->_defn;
 }
 
+/* Return nonzero if a target pattern whose text after the % is SUFFIX, SLEN
+   long, may match a name ending in TAIL, TLEN long.  If STEM is nonzero a
+   stem comes before TAIL, and can supply the rest of SUFFIX.  */
+
+static int
+tail_may_match (const char *tail, size_t tlen,
+                const char *suffix, size_t slen, int stem)
+{
+  if (slen <= tlen)
+    return memcmp (tail + tlen - slen, suffix, slen) == 0;
+  return stem && memcmp (suffix + slen - tlen, tail, tlen) == 0;
+}
+
+/* Note which pattern rules have a prerequisite that another rule may make
+   as an intermediate file.  Only a rule with a target ending the way the
+   prerequisite does can make it, and one matching anything does so only if
+   it is terminal.  A rule without such a prerequisite fails with
+   intermediate files just as it did without them, so pattern_search does
+   not try it again.  Where only the terminal rules matching anything could
+   make one, such as those checking files out of RCS or SCCS, whether they
+   can is told from the directories their prerequisites would be in.  */
+
+static void
+mark_chaining_rules (void)
+{
+  struct rule *rule;
+
+  free (anything_rules);
+  anything_rules = 0;
+  num_anything_rules = 0;
+
+  for (rule = pattern_rules; rule != 0; rule = rule->next)
+    {
+      unsigned int i;
+
+      if (!rule->terminal || (rule->deps == 0 && rule->cmds == 0))
+        continue;
+      for (i = 0; i < rule->num; ++i)
+        if (rule->targets[i][1] == '\0')
+          {
+            anything_rules = xrealloc (anything_rules,
+                                       (num_anything_rules + 1)
+                                       * sizeof (struct rule *));
+            anything_rules[num_anything_rules++] = rule;
+            break;
+          }
+    }
+
+  for (rule = pattern_rules; rule != 0; rule = rule->next)
+    {
+      struct dep *dep;
+
+      rule->chains = num_anything_rules != 0 ? 2 : 0;
+      for (dep = rule->deps; dep != 0 && rule->chains != 1; dep = dep->next)
+        {
+          const char *dname = dep_name (dep);
+          const char *p = strchr (dname, '%');
+          const char *tail = p != 0 ? p + 1 : dname;
+          size_t tlen = strlen (tail);
+          struct rule *r;
+
+          /* Names known only after the second expansion, and archive
+             members, which are looked up by their member name.  */
+          if (dep->need_2nd_expansion || strchr (dname, '(') != 0)
+            {
+              rule->chains = 1;
+              break;
+            }
+
+          for (r = pattern_rules; r != 0 && rule->chains != 1; r = r->next)
+            {
+              unsigned int i;
+
+              if (r->deps == 0 && r->cmds == 0)
+                continue;
+
+              for (i = 0; i < r->num; ++i)
+                if (r->targets[i][1] != '\0'
+                    && tail_may_match (tail, tlen, r->suffixes[i],
+                                       strlen (r->suffixes[i]), p != 0))
+                  {
+                    rule->chains = 1;
+                    break;
+                  }
+            }
+        }
+
+      if (rule->deps == 0 || rule->terminal)
+        continue;
+      if (rule->chains == 0)
+        DB (DB_IMPLICIT,
+            (_("Pattern rule '%s' is not tried with intermediate files.\n"),
+             get_rule_defn (rule)));
+      else if (rule->chains == 2)
+        DB (DB_IMPLICIT,
+            (_("Pattern rule '%s' is tried with intermediate files from "
+               "terminal rules only.\n"), get_rule_defn (rule)));
+    }
+}
+
 /* Compute the maximum dependency length and maximum number of dependencies of
    all implicit rules.  Also sets the subdir flag for a rule when appropriate,
    possibly removing the rule completely when appropriate.
@@ -198,6 +306,8 @@ count_implicit_rule_limits (void)
     }
 
   free (name);
+
+  mark_chaining_rules ();
 }
 
 /* Create a pattern rule from a suffix rule.
@@ -342,9 +452,13 @@ new_pattern_rule (struct rule *rule, int override)
 
   rule->in_use = 0;
   rule->terminal = 0;
+  rule->chains = 1;
+  rule->_defn = NULL;
 
   rule->next = 0;
 
+  invalidate_pattern_index ();
+
   /* Search for an identical rule.  */
   lastrule = 0;
   for (r = pattern_rules; r != 0; lastrule = r, r = r->next)
@@ -455,6 +569,8 @@ freerule (struct rule *rule, struct rule *lastrule)
 {
   struct rule *next = rule->next;
 
+  invalidate_pattern_index ();
+
   free_dep_chain (rule->deps);
 
   /* MSVC erroneously warns without a cast here.  */
@@ -522,6 +638,344 @@ create_pattern_rule (const char **targets, const char **target_percents,
     r->terminal = (char) terminal;
 }
 
+/* An index of % patterns.  A pattern with text after its % is listed
+   under that suffix; one with only text before its % under that prefix;
+   and one that is just % on a list of its own.  Since the text around the
+   % must match a name literally, looking up the tails and heads of a name
+   finds every pattern that can match it.  */
+
+static unsigned long
+pattern_key_hash_1 (const void *key)
+{
+  const struct pattern_key *k = key;
+  return_STRING_N_HASH_1 (k->text, k->len);
+}
+
+static unsigned long
+pattern_key_hash_2 (const void *key)
+{
+  const struct pattern_key *k = key;
+  return_STRING_N_HASH_2 (k->text, k->len);
+}
+
+static int
+pattern_key_hash_cmp (const void *x, const void *y)
+{
+  const struct pattern_key *a = x;
+  const struct pattern_key *b = y;
+  int r = a->len - b->len;
+  if (r)
+    return r;
+  return_STRING_N_COMPARE (a->text, b->text, a->len);
+}
+
+static void
+free_pattern_key (const void *item)
+{
+  struct pattern_key *k = (struct pattern_key *) item;
+  free (k->nums);
+  free (k);
+}
+
+static void
+add_pattern_num (struct pattern_key *k, unsigned int num)
+{
+  if (k->count == k->size)
+    {
+      k->size = k->size ? k->size * 2 : 4;
+      k->nums = xrealloc (k->nums, k->size * sizeof (unsigned int));
+    }
+  k->nums[k->count++] = num;
+}
+
+/* Add pattern number NUM to the key TEXT, LEN bytes long, in TABLE.  LENS
+   holds the distinct lengths of the keys in TABLE.  */
+
+static void
+add_pattern_key (struct hash_table *table, const char *text, unsigned int len,
+                 unsigned int num, unsigned int *lens, unsigned int *nlens)
+{
+  struct pattern_key key;
+  struct pattern_key **slot;
+  struct pattern_key *k;
+
+  key.text = text;
+  key.len = len;
+  slot = (struct pattern_key **) hash_find_slot (table, &key);
+  k = *slot;
+  if (HASH_VACANT (k))
+    {
+      unsigned int i;
+
+      k = xcalloc (sizeof (struct pattern_key));
+      k->text = text;
+      k->len = len;
+      hash_insert_at (table, k, slot);
+
+      for (i = 0; i < *nlens; ++i)
+        if (lens[i] == len)
+          break;
+      if (i == *nlens)
+        lens[(*nlens)++] = len;
+    }
+
+  add_pattern_num (k, num);
+}
+
+/* Get IX ready to hold up to SIZE patterns.  */
+
+void
+pattern_index_init (struct pattern_index *ix, unsigned int size)
+{
+  hash_init (&ix->suffixes, 61, pattern_key_hash_1, pattern_key_hash_2,
+             pattern_key_hash_cmp);
+  hash_init (&ix->prefixes, 61, pattern_key_hash_1, pattern_key_hash_2,
+             pattern_key_hash_cmp);
+  memset (&ix->anything, '\0', sizeof (ix->anything));
+  ix->suffix_lens = xmalloc ((size + 1) * sizeof (unsigned int));
+  ix->prefix_lens = xmalloc ((size + 1) * sizeof (unsigned int));
+  ix->num_suffix_lens = ix->num_prefix_lens = 0;
+  ix->found = 0;
+  ix->found_size = 0;
+}
+
+/* Add PATTERN, LEN bytes long, whose text after the % starts at SUFFIX, to
+   IX as number NUM.  The patterns must be added in the order of their
+   numbers.  */
+
+void
+pattern_index_add (struct pattern_index *ix, const char *pattern,
+                   const char *suffix, unsigned int len, unsigned int num)
+{
+  unsigned int plen = suffix - pattern - 1;
+
+  if (*suffix != '\0')
+    add_pattern_key (&ix->suffixes, suffix, len - plen - 1, num,
+                     ix->suffix_lens, &ix->num_suffix_lens);
+  else if (plen != 0)
+    add_pattern_key (&ix->prefixes, pattern, plen, num,
+                     ix->prefix_lens, &ix->num_prefix_lens);
+  else
+    add_pattern_num (&ix->anything, num);
+}
+
+void
+pattern_index_free (struct pattern_index *ix)
+{
+  hash_map (&ix->suffixes, free_pattern_key);
+  hash_free (&ix->suffixes, 0);
+  hash_map (&ix->prefixes, free_pattern_key);
+  hash_free (&ix->prefixes, 0);
+  free (ix->anything.nums);
+  free (ix->suffix_lens);
+  free (ix->prefix_lens);
+  free (ix->found);
+  memset (ix, '\0', sizeof (*ix));
+}
+
+/* Return the key TEXT, LEN bytes long, in TABLE, or null.  */
+
+static const struct pattern_key *
+find_pattern_key (struct hash_table *table, const char *text, unsigned int len)
+{
+  struct pattern_key key;
+
+  key.text = text;
+  key.len = len;
+  return hash_find_item (table, &key);
+}
+
+static int
+unsigned_compare (const void *v1, const void *v2)
+{
+  unsigned int a = *(const unsigned int *) v1;
+  unsigned int b = *(const unsigned int *) v2;
+  return a < b ? -1 : a > b;
+}
+
+/* Find the patterns in IX that may match NAME, NAMELEN bytes long.  If
+   LASTSLASH is not nil, prefixes are also looked for after it, for patterns
+   that are matched against the name without its directory.  Patterns that
+   cannot match because the text around their % is not in NAME are left
+   out; NAME must still be matched against the rest, which have text on
+   both sides of the %.  Point *NUMS at their numbers, in ascending order,
+   which stay valid until IX is next searched or changed.  Return how many
+   there are.  */
+
+unsigned int
+pattern_index_find (struct pattern_index *ix, const char *name,
+                    size_t namelen, const char *lastslash,
+                    const unsigned int **nums)
+{
+  const struct pattern_key **keys;
+  unsigned int nkeys = 0;
+  unsigned int count = 0;
+  unsigned int i;
+
+  keys = alloca ((ix->num_suffix_lens + ix->num_prefix_lens * 2 + 1)
+                 * sizeof (struct pattern_key *));
+
+  for (i = 0; i < ix->num_suffix_lens; ++i)
+    if (ix->suffix_lens[i] <= namelen)
+      {
+        const struct pattern_key *k;
+        k = find_pattern_key (&ix->suffixes,
+                              name + namelen - ix->suffix_lens[i],
+                              ix->suffix_lens[i]);
+        if (k != 0)
+          keys[nkeys++] = k;
+      }
+
+  for (i = 0; i < ix->num_prefix_lens; ++i)
+    {
+      const struct pattern_key *k = 0;
+      if (ix->prefix_lens[i] <= namelen)
+        {
+          k = find_pattern_key (&ix->prefixes, name, ix->prefix_lens[i]);
+          if (k != 0)
+            keys[nkeys++] = k;
+        }
+      if (lastslash != 0
+          && ix->prefix_lens[i] <= namelen - (lastslash + 1 - name))
+        {
+          const struct pattern_key *k2;
+          k2 = find_pattern_key (&ix->prefixes, lastslash + 1,
+                                 ix->prefix_lens[i]);
+          if (k2 != 0 && k2 != k)
+            keys[nkeys++] = k2;
+        }
+    }
+
+  if (ix->anything.count != 0)
+    keys[nkeys++] = &ix->anything;
+
+  /* The numbers under a single key are in order already.  */
+  if (nkeys == 0)
+    return 0;
+  if (nkeys == 1)
+    {
+      *nums = keys[0]->nums;
+      return keys[0]->count;
+    }
+
+  for (i = 0; i < nkeys; ++i)
+    count += keys[i]->count;
+  if (count > ix->found_size)
+    {
+      ix->found_size = count;
+      ix->found = xrealloc (ix->found, count * sizeof (unsigned int));
+    }
+
+  count = 0;
+  for (i = 0; i < nkeys; ++i)
+    {
+      memcpy (ix->found + count, keys[i]->nums,
+              keys[i]->count * sizeof (unsigned int));
+      count += keys[i]->count;
+    }
+  qsort (ix->found, count, sizeof (unsigned int), unsigned_compare);
+
+  *nums = ix->found;
+  return count;
+}
+
+/* The index of pattern rule targets.  Every target of every rule is
+   numbered in the order pattern_search must consider them.  */
+
+static struct pattern_index pattern_index;
+
+/* All the targets, in order, and how many there are.  */
+static struct rule_target *pattern_targets;
+static unsigned int num_pattern_targets;
+
+static int pattern_index_valid = 0;
+
+static void
+invalidate_pattern_index (void)
+{
+  if (!pattern_index_valid)
+    return;
+
+  pattern_index_free (&pattern_index);
+  free (pattern_targets);
+  pattern_targets = 0;
+  pattern_index_valid = 0;
+}
+
+static void
+build_pattern_index (void)
+{
+  struct rule *rule;
+  unsigned int n = 0;
+
+  for (rule = pattern_rules; rule != 0; rule = rule->next)
+    n += rule->num;
+
+  pattern_index_init (&pattern_index, n);
+  pattern_targets = xmalloc ((n + 1) * sizeof (struct rule_target));
+
+  n = 0;
+  for (rule = pattern_rules; rule != 0; rule = rule->next)
+    {
+      unsigned int ti;
+
+      for (ti = 0; ti < rule->num; ++ti, ++n)
+        {
+          pattern_targets[n].rule = rule;
+          pattern_targets[n].ti = ti;
+          pattern_targets[n].num = n;
+          pattern_index_add (&pattern_index, rule->targets[ti],
+                             rule->suffixes[ti], rule->lens[ti], n);
+        }
+    }
+
+  num_pattern_targets = n;
+  pattern_index_valid = 1;
+}
+
+/* Find the pattern rule targets that may match FILENAME, NAMELEN bytes
+   long, whose last slash is LASTSLASH (or nil).  Targets that cannot match
+   because the text around their % is not in FILENAME are left out; the
+   rest are put in a new array in *TARGETS, in the order of the rules.
+   Return how many there are.  */
+
+unsigned int
+find_pattern_targets (const char *filename, size_t namelen,
+                      const char *lastslash, struct rule_target **targets)
+{
+  const unsigned int *nums;
+  unsigned int count;
+  unsigned int i;
+
+  if (!pattern_index_valid)
+    build_pattern_index ();
+
+  count = pattern_index_find (&pattern_index, filename, namelen, lastslash,
+                              &nums);
+
+  *targets = xmalloc ((count + 1) * sizeof (struct rule_target));
+  for (i = 0; i < count; ++i)
+    (*targets)[i] = pattern_targets[nums[i]];
+
+  return count;
+}
+
+/* Store the pattern rule target numbered NUM in *TARGET.  Return zero if
+   there is no such target.  */
+
+int
+find_pattern_target (unsigned int num, struct rule_target *target)
+{
+  if (!pattern_index_valid)
+    build_pattern_index ();
+
+  if (num >= num_pattern_targets)
+    return 0;
+
+  *target = pattern_targets[num];
+  return 1;
+}
+
 /* Print the data base of rules.  */
 
 static void                     /* Useful to call from gdb.  */
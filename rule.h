@@ -29,6 +29,42 @@ struct rule
     unsigned short num;         /* Number of targets.  */
     char terminal;              /* If terminal (double-colon).  */
     char in_use;                /* If in use by a parent pattern_search.  */
+    char chains;                /* If another rule may make a prerequisite:
+                                   2 if only those in anything_rules.  */
+  };
+
+/* A target of a pattern rule, as found by find_pattern_targets.  */
+struct rule_target
+  {
+    struct rule *rule;
+    unsigned int ti;            /* Index of the target in RULE.  */
+    unsigned int num;           /* Number of the target among all of them,
+                                   in the order of the rules.  */
+  };
+
+/* An index of % patterns, numbered in the order they are to be tried.
+   Each key is a suffix or prefix, with the numbers of the patterns listed
+   under it; see pattern_index_find.  */
+struct pattern_key
+  {
+    const char *text;           /* The suffix or prefix.  */
+    unsigned int len;           /* Its length.  */
+    unsigned int count;         /* Number of patterns listed.  */
+    unsigned int size;          /* Room for patterns in NUMS.  */
+    unsigned int *nums;         /* Numbers of the patterns, ascending.  */
+  };
+
+struct pattern_index
+  {
+    struct hash_table suffixes; /* Patterns with text after their %.  */
+    struct hash_table prefixes; /* Those with text only before it.  */
+    struct pattern_key anything; /* Those that are just %.  */
+    unsigned int *suffix_lens;  /* The distinct lengths of the keys.  */
+    unsigned int num_suffix_lens;
+    unsigned int *prefix_lens;
+    unsigned int num_prefix_lens;
+    unsigned int *found;        /* Room for what pattern_index_find finds.  */
+    unsigned int found_size;
   };
 
 /* For calling install_pattern_rule.  */
@@ -45,6 +81,8 @@ extern unsigned int num_pattern_rules;
 extern unsigned int max_pattern_deps;
 extern unsigned int max_pattern_targets;
 extern size_t max_pattern_dep_length;
+extern struct rule **anything_rules;
+extern unsigned int num_anything_rules;
 
 extern struct file *suffix_file;
 
@@ -56,4 +94,16 @@ void create_pattern_rule (const char **targets, const char **target_percents,
                           unsigned int num, int terminal, struct dep *deps,
                           struct commands *commands, int override);
 const char *get_rule_defn (struct rule *rule);
+unsigned int find_pattern_targets (const char *filename, size_t namelen,
+                                   const char *lastslash,
+                                   struct rule_target **targets);
+int find_pattern_target (unsigned int num, struct rule_target *target);
+void pattern_index_init (struct pattern_index *ix, unsigned int size);
+void pattern_index_add (struct pattern_index *ix, const char *pattern,
+                        const char *suffix, unsigned int len,
+                        unsigned int num);
+void pattern_index_free (struct pattern_index *ix);
+unsigned int pattern_index_find (struct pattern_index *ix, const char *name,
+                                 size_t namelen, const char *lastslash,
+                                 const unsigned int **nums);
 void print_rule_data_base (void);
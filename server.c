@@ -0,0 +1,1610 @@
+/* Resident make server for Make+.
+This file is part of Make+.
+
+Make+ is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+Make+ is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+
+#ifdef MAKE_SERVER
+
+#include "filedef.h"
+#include "dep.h"
+#include "job.h"
+#include "variable.h"
+#include "debug.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/inotify.h>
+
+/* 'make --server' reads the makefiles and then, instead of updating the
+   goals, listens on a Unix domain socket.  'make --client' run with the
+   same arguments, environment and working directory sends its standard
+   input, output and error over the socket, and the server updates the
+   goals for it with the database it already has, then tells the client
+   what status to exit with.  A client whose request differs in any of
+   these is turned away and makes the goals itself, as it also does when
+   no server is listening.  Only the user the server runs as can connect:
+   the socket is created with mode 0600, and connections from processes
+   of any other user are dropped.
+
+   Between requests the server keeps the timestamps it has found, and
+   uses inotify to learn which of them have gone stale.  Each file whose
+   directory is watched keeps its timestamp until an event for it comes
+   in; other files, such as symlinks, archive members and files found
+   through vpath, are stat()ed again for every request.
+
+   A state file named by the makefiles is read once, and written after
+   each request.  Files change under the server between requests, and it
+   keeps their timestamps itself, so it records none there; only the
+   digests and the .RESTAT, .CMDCHECK and .RULECACHE records are kept.
+
+   When the directory cache would answer a question make has already
+   asked differently, or a makefile or anything it depends on changes, or
+   the event queue overflows, what the server has in memory can no longer
+   be trusted.  It then executes itself afresh, passing the listening
+   socket (and the connection of a client that is waiting, if any) on to
+   the new process in MAKE_SERVER_FDS, and the new process reads the
+   makefiles again.  The same happens after a fatal error or a signal in
+   the middle of a request.  */
+
+/* The request a client sends is a series of NUL-terminated strings: the
+   magic string, the client's working directory, the number of arguments
+   and the arguments, and the number of environment entries and the
+   entries.  Its standard input, output and error come with the first part,
+   as SCM_RIGHTS.  The server answers with lines of text: "pid N" once it
+   has taken the request, where kill(N) reaches it and its children, then
+   "exit N" or "signal N"; or "refused REASON".  */
+
+#define REQUEST_MAGIC   "make-request 1"
+
+#define SERVER_FDS_NAME "MAKE_SERVER_FDS"
+
+/* The events that can make something the server knows stale.  */
+
+#define WATCH_MASK (IN_ATTRIB | IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE      \
+                    | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO               \
+                    | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+#define ENTRY_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+/* Once the server has to re-read the makefiles, it waits until the file
+   system has been quiet for this many milliseconds, so that it does not
+   start over in the middle of an editor's save or a checkout.  A request
+   that comes in is served by the new server straight away.  */
+
+#define RESTART_DELAY 200
+
+/* Environment variables that may differ between a client and the server
+   without changing what make does.  */
+
+static const char *const volatile_env[] =
+  {
+    "_", "PWD", "OLDPWD", "SHLVL", "MAKE_RESTARTS", SERVER_FDS_NAME, 0
+  };
+
+/* A directory the server has asked inotify about, under one of its names.
+   A directory that did not exist has WD -1; its parent is watched for it
+   to turn up.  */
+
+struct watched_dir
+  {
+    const char *name;           /* Name of the directory (strcache'd).  */
+    int wd;                     /* Watch descriptor, or -1.  */
+    struct watched_dir *next;   /* Next name with the same WD.  */
+  };
+
+/* A directory entry that was created or removed, to be looked at once the
+   events read together have all been gone through.  */
+
+struct entry_event
+  {
+    const char *dir;
+    const char *name;
+  };
+
+/* Per-file state to put back before each request: what a fresh make would
+   have after rebuilding its makefiles, when it starts on the goals.  */
+
+struct file_state
+  {
+    struct file *file;
+    FILE_TIMESTAMP last_mtime;
+    FILE_TIMESTAMP mtime_before_update;
+    enum update_status update_status;
+    enum cmd_state command_state;
+    unsigned int updated:1;
+    unsigned int dontcare:1;
+    unsigned int no_diag:1;
+  };
+
+/* The process that is the server, or 0.  Its children are not.  */
+static pid_t server_pid = 0;
+
+/* Absolute name of the socket, if this process created it.  */
+static char *socket_path = 0;
+
+static int listen_fd = -1;
+static int inotify_fd = -1;
+
+/* The connection of the client being served, or the one a previous server
+   handed over; -1 if none.  */
+static int client_fd = -1;
+
+/* Nonzero while a request is being served.  */
+static int serving = 0;
+
+/* Our own standard descriptors, while the client's are in their place.  */
+static int saved_fds[3] = { -1, -1, -1 };
+
+/* Our arguments and environment, as we were started with them.  */
+static int server_argc;
+static char **server_argv;
+static char **server_env;
+
+/* Environment to execute ourselves with after a signal, made in advance.  */
+static char **restart_env;
+
+/* Nonzero once what the server knows can no longer be trusted.  */
+static int restart_pending = 0;
+
+/* Watched directories by name, and by watch descriptor.  */
+static struct hash_table watched_dirs;
+static struct watched_dir **watches_by_wd = 0;
+static int watches_by_wd_size = 0;
+
+/* Directories watched since they were last checked against the cache.  */
+static const char **new_watches = 0;
+static unsigned int new_watch_count = 0, new_watch_size = 0;
+
+/* Names of the makefiles and of the files they depend on.  */
+static struct hash_table restart_names;
+
+static struct file_state *file_states = 0;
+static unsigned int file_state_count = 0, file_state_size = 0;
+
+static struct entry_event *entry_events = 0;
+static unsigned int entry_event_count = 0, entry_event_size = 0;
+
+/* Value of rehashed_files when we started serving.  */
+static unsigned int files_rehashed;
+
+static unsigned long
+watched_dir_hash_1 (const void *key)
+{
+  return_ISTRING_HASH_1 (((const struct watched_dir *) key)->name);
+}
+
+static unsigned long
+watched_dir_hash_2 (const void *key)
+{
+  return_ISTRING_HASH_2 (((const struct watched_dir *) key)->name);
+}
+
+static int
+watched_dir_hash_cmp (const void *x, const void *y)
+{
+  return_ISTRING_COMPARE (((const struct watched_dir *) x)->name,
+                          ((const struct watched_dir *) y)->name);
+}
+
+static unsigned long
+name_hash_1 (const void *key)
+{
+  return_ISTRING_HASH_1 ((const char *) key);
+}
+
+static unsigned long
+name_hash_2 (const void *key)
+{
+  return_ISTRING_HASH_2 ((const char *) key);
+}
+
+static int
+name_hash_cmp (const void *x, const void *y)
+{
+  return_ISTRING_COMPARE ((const char *) x, (const char *) y);
+}
+
+static void
+set_cloexec (int fd, int on)
+{
+  int flags = fcntl (fd, F_GETFD);
+
+  if (flags >= 0)
+    fcntl (fd, F_SETFD, on ? flags | FD_CLOEXEC : flags & ~FD_CLOEXEC);
+}
+
+/* Write all of BUF to the socket FD.  Return nonzero on success.  A peer
+   that has gone away makes this fail rather than raise SIGPIPE.  */
+
+static int
+write_all (int fd, const char *buf, size_t len)
+{
+  while (len > 0)
+    {
+      ssize_t n;
+
+      EINTRLOOP (n, send (fd, buf, len, MSG_NOSIGNAL));
+      if (n <= 0)
+        return 0;
+      buf += n;
+      len -= n;
+    }
+
+  return 1;
+}
+
+/* Send the line "WHAT N" to the client.  A client that has gone away no
+   longer cares.  */
+
+static void
+reply (int fd, const char *what, long n)
+{
+  char buf[64];
+
+  sprintf (buf, "%s %ld\n", what, n);
+  write_all (fd, buf, strlen (buf));
+}
+
+/* Return the name of the file NAME in the directory DIR.  The result is in
+   concat()'s buffer.  */
+
+static const char *
+dir_entry_name (const char *dir, const char *name)
+{
+  if (streq (dir, "."))
+    return concat (1, name);
+  if (streq (dir, "/"))
+    return concat (2, "/", name);
+  return concat (3, dir, "/", name);
+}
+
+/* Return the strcache'd name of the directory FILE is in, or null if its
+   name is not one we can watch.  */
+
+static const char *
+file_dir_name (const char *name)
+{
+  const char *slash = strrchr (name, '/');
+
+  if (slash == 0)
+    return strcache_add (".");
+  if (slash == name)
+    return strcache_add ("/");
+  if (slash[1] == '\0')
+    return 0;
+  return strcache_add_len (name, slash - name);
+}
+
+/* Return the strcache'd name of the directory DIR is in, or null if there
+   is no telling from the name.  */
+
+static const char *
+parent_dir_name (const char *dir)
+{
+  const char *slash = strrchr (dir, '/');
+  const char *last = slash ? slash + 1 : dir;
+
+  if (streq (last, ".") || streq (last, "..") || streq (dir, "/"))
+    return 0;
+  return file_dir_name (dir);
+}
+
+/* Execute ourselves afresh, handing over the listening socket and CONN.
+   ENV is the environment to use; if it is null, make one.  */
+
+static void NORETURN
+restart_server (int conn, char **env)
+{
+  if (env == 0)
+    {
+      unsigned int n = 0;
+      char *fds;
+
+      while (server_env[n] != 0)
+        ++n;
+      env = xmalloc ((n + 2) * sizeof (char *));
+      memcpy (env, server_env, n * sizeof (char *));
+      fds = xmalloc (CSTRLEN (SERVER_FDS_NAME) + 2 + 2 * INTSTR_LENGTH);
+      sprintf (fds, "%s=%d,%d", SERVER_FDS_NAME, listen_fd, conn);
+      env[n] = fds;
+      env[n + 1] = 0;
+    }
+
+  DB (DB_BASIC, (_("Re-executing the make server.\n")));
+
+  set_cloexec (listen_fd, 0);
+  if (conn >= 0)
+    set_cloexec (conn, 0);
+
+  fflush (stdout);
+  fflush (stderr);
+
+  if (directory_before_chdir != 0 && chdir (directory_before_chdir) < 0)
+    perror_with_name ("chdir", "");
+
+  exec_command (server_argv, env);
+}
+
+/* Put our own standard descriptors back.  */
+
+static void
+restore_std_fds (void)
+{
+  int i;
+
+  fflush (stdout);
+  fflush (stderr);
+  for (i = 0; i < 3; ++i)
+    if (saved_fds[i] >= 0)
+      {
+        dup2 (saved_fds[i], i);
+        close (saved_fds[i]);
+        saved_fds[i] = -1;
+      }
+}
+
+/* Note that what the server knows can no longer be trusted, because of
+   WHAT.  */
+
+static void
+need_restart (const char *what)
+{
+  if (!restart_pending)
+    DB (DB_BASIC, (_("Make server: '%s' changed; will re-read makefiles.\n"),
+                   what));
+  restart_pending = 1;
+}
+
+/* Watching.  */
+
+/* Start watching the directory DIR, and the directories it is in.  */
+
+static void
+watch_dir (const char *dir)
+{
+  struct watched_dir key;
+  struct watched_dir **slot;
+  struct watched_dir *w;
+  const char *parent;
+  int wd;
+
+  key.name = dir;
+  slot = (struct watched_dir **) hash_find_slot (&watched_dirs, &key);
+  if (! HASH_VACANT (*slot))
+    return;
+
+  w = xmalloc (sizeof (struct watched_dir));
+  w->name = dir;
+  w->next = 0;
+  hash_insert_at (&watched_dirs, w, slot);
+
+  EINTRLOOP (wd, inotify_add_watch (inotify_fd, dir, WATCH_MASK));
+  w->wd = wd;
+  if (wd < 0)
+    {
+      if (errno != ENOENT && errno != ENOTDIR && errno != EACCES)
+        pfatal_with_name (dir);
+    }
+  else
+    {
+      if (wd >= watches_by_wd_size)
+        {
+          int n = watches_by_wd_size;
+          watches_by_wd_size = wd * 2 + 16;
+          watches_by_wd = xrealloc (watches_by_wd, watches_by_wd_size
+                                    * sizeof (struct watched_dir *));
+          memset (watches_by_wd + n, 0,
+                  (watches_by_wd_size - n) * sizeof (struct watched_dir *));
+        }
+      w->next = watches_by_wd[wd];
+      watches_by_wd[wd] = w;
+    }
+
+  if (new_watch_count == new_watch_size)
+    {
+      new_watch_size = new_watch_size ? new_watch_size * 2 : 64;
+      new_watches = xrealloc (new_watches,
+                              new_watch_size * sizeof (const char *));
+    }
+  new_watches[new_watch_count++] = dir;
+
+  /* If a directory this one is in is renamed, this name no longer leads
+     to it.  If this one does not exist, watch for it to turn up.  */
+  parent = parent_dir_name (dir);
+  if (parent != 0)
+    watch_dir (parent);
+  else if (wd < 0 && !streq (dir, "."))
+    watch_dir (strcache_add ("."));
+}
+
+static int
+dir_is_watched (const char *dir)
+{
+  struct watched_dir key;
+  struct watched_dir *w;
+
+  key.name = dir;
+  w = hash_find_item (&watched_dirs, &key);
+  return w != 0 && w->wd >= 0;
+}
+
+static void
+watch_cached_dir (const char *name, int exists UNUSED, void *arg UNUSED)
+{
+  watch_dir (name);
+}
+
+/* Watch the directory FILE is in and, if FILE's timestamp can be kept from
+   one request to the next, say so.  */
+
+static void
+watch_file (const void *item)
+{
+  struct file *f;
+
+  for (f = (struct file *) item; f != 0; f = f->prev)
+    {
+      const char *dir;
+      struct stat st;
+      int r;
+
+      if (f->watched || f->phony || f->name != f->hname)
+        continue;
+#ifndef NO_ARCHIVES
+      if (ar_name (f->name))
+        continue;
+#endif
+
+      dir = file_dir_name (f->name);
+      if (dir == 0)
+        continue;
+      watch_dir (dir);
+      if (!dir_is_watched (dir))
+        continue;
+
+      EINTRLOOP (r, lstat (f->name, &st));
+      if (r == 0 ? S_ISLNK (st.st_mode) || S_ISDIR (st.st_mode)
+          : errno != ENOENT)
+        continue;
+
+      /* What we know about it from before may already be out of date.  */
+      f->watched = 1;
+      f->last_mtime = UNKNOWN_MTIME;
+    }
+}
+
+/* Watch everything the database and the directory cache refer to.  Return
+   nonzero if a directory that was not watched before has changed since it
+   was read in.  */
+
+static int
+add_watches (void)
+{
+  unsigned int i;
+  int changed = 0;
+
+  new_watch_count = 0;
+  map_files (watch_file);
+  map_directories (watch_cached_dir, 0);
+
+  for (i = 0; i < new_watch_count && !changed; ++i)
+    if (dir_contents_changed (new_watches[i]))
+      {
+        need_restart (new_watches[i]);
+        changed = 1;
+      }
+
+  return changed;
+}
+
+/* Add FILE, and every file it depends on, to the files whose changes mean
+   the makefiles must be read again.  */
+
+static void
+add_restart_name (struct file *file)
+{
+  const char **slot;
+  struct dep *d;
+  struct file *f;
+
+  check_renamed (file);
+  slot = (const char **) hash_find_slot (&restart_names, file->name);
+  if (! HASH_VACANT (*slot))
+    return;
+  hash_insert_at (&restart_names, file->name, slot);
+
+  for (f = file->double_colon ? file->double_colon : file; f != 0; f = f->prev)
+    for (d = f->deps; d != 0; d = d->next)
+      add_restart_name (d->file);
+}
+
+/* Remember what each file looks like now, as far as updating goes.  */
+
+static void
+save_file_state (const void *item)
+{
+  struct file *f;
+
+  for (f = (struct file *) item; f != 0; f = f->prev)
+    {
+      struct file_state *s;
+
+      if (f->update_status == us_none && f->command_state == cs_not_started
+          && !f->updated && !f->dontcare && !f->no_diag
+          && f->last_mtime != OLD_MTIME && f->last_mtime != NEW_MTIME)
+        continue;
+
+      if (file_state_count == file_state_size)
+        {
+          file_state_size = file_state_size ? file_state_size * 2 : 64;
+          file_states = xrealloc (file_states, file_state_size
+                                  * sizeof (struct file_state));
+        }
+      s = &file_states[file_state_count++];
+      s->file = f;
+      s->update_status = f->update_status;
+      s->command_state = f->command_state;
+      s->updated = f->updated;
+      s->dontcare = f->dontcare;
+      s->no_diag = f->no_diag;
+      if (f->last_mtime == OLD_MTIME || f->last_mtime == NEW_MTIME)
+        {
+          s->last_mtime = f->last_mtime;
+          s->mtime_before_update = f->mtime_before_update;
+        }
+      else
+        s->last_mtime = s->mtime_before_update = UNKNOWN_MTIME;
+    }
+}
+
+/* Make FILE look as it did when the server was started, but keep its
+   timestamp if nothing can have changed it since.  */
+
+static void
+reset_file (const void *item)
+{
+  struct file *f;
+
+  for (f = (struct file *) item; f != 0; f = f->prev)
+    {
+      f->updated = f->updating = f->dontcare = f->no_diag = 0;
+      f->mtime_queued = 0;
+      f->update_status = us_none;
+      f->command_state = cs_not_started;
+      f->parent = 0;
+
+      if (f->phony)
+        f->last_mtime = f->mtime_before_update = NONEXISTENT_MTIME;
+      else
+        {
+          if (!f->watched
+              || (f->last_mtime != NONEXISTENT_MTIME
+                  && (f->last_mtime < ORDINARY_MTIME_MIN
+                      || f->last_mtime > ORDINARY_MTIME_MAX)))
+            f->last_mtime = UNKNOWN_MTIME;
+          f->mtime_before_update = UNKNOWN_MTIME;
+        }
+    }
+}
+
+static void
+reset_files (void)
+{
+  unsigned int i;
+
+  map_files (reset_file);
+
+  for (i = 0; i < file_state_count; ++i)
+    {
+      const struct file_state *s = &file_states[i];
+      struct file *f = s->file;
+
+      f->update_status = s->update_status;
+      f->command_state = s->command_state;
+      f->updated = s->updated;
+      f->dontcare = s->dontcare;
+      f->no_diag = s->no_diag;
+      if (s->last_mtime != UNKNOWN_MTIME)
+        {
+          f->last_mtime = s->last_mtime;
+          f->mtime_before_update = s->mtime_before_update;
+        }
+    }
+}
+
+/* Forget the timestamp of the file NAME, if it is in the database.  */
+
+static struct file *
+forget_mtime (const char *name)
+{
+  struct file *file = lookup_file (name);
+  struct file *f;
+
+  for (f = file; f != 0; f = f->prev)
+    f->last_mtime = UNKNOWN_MTIME;
+
+  return file;
+}
+
+/* Look at an entry of DIR that was created or removed.  If make already
+   relied on it not being there, or being there, start over.  Otherwise
+   bring the directory cache up to date.  */
+
+static void
+check_entry (const char *dir, const char *name)
+{
+  const char *path = dir_entry_name (dir, name);
+  struct stat st;
+  struct file *f;
+  int exists, known, r;
+
+  EINTRLOOP (r, lstat (path, &st));
+  exists = r == 0;
+
+  known = dir_file_known (dir, name);
+  if (known < 0 || known == exists)
+    return;
+
+  /* A file that make knows how to remake may come and go without changing
+     which rules apply, unless the makefiles looked for it themselves.  */
+  f = lookup_file (path);
+  switch (dir_file_queried (dir, name))
+    {
+    case DIR_QUERY_PARSE:
+      need_restart (path);
+      return;
+    case DIR_QUERY_BUILD:
+      if (f == 0 || f->cmds == 0)
+        {
+          need_restart (path);
+          return;
+        }
+      break;
+    }
+
+  dir_file_changed (dir, name, exists);
+}
+
+/* Read the events that have come in and act on them.  */
+
+static void
+read_events (void)
+{
+  char buf[16 * 1024] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+  unsigned int i;
+
+  while (1)
+    {
+      ssize_t len;
+      char *p;
+
+      EINTRLOOP (len, read (inotify_fd, buf, sizeof (buf)));
+      if (len < 0)
+        {
+          if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+          pfatal_with_name ("inotify");
+        }
+
+      for (p = buf; p < buf + len;
+           p += sizeof (struct inotify_event) + ((struct inotify_event *) p)->len)
+        {
+          const struct inotify_event *ev = (const struct inotify_event *) p;
+          struct watched_dir *w;
+
+          if (ev->mask & IN_Q_OVERFLOW)
+            {
+              need_restart (_("the event queue"));
+              continue;
+            }
+          if (ev->wd < 0 || ev->wd >= watches_by_wd_size)
+            continue;
+
+          for (w = watches_by_wd[ev->wd]; w != 0; w = w->next)
+            {
+              struct watched_dir key;
+              const char *path;
+              struct file *f;
+
+              if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF
+                              | IN_UNMOUNT))
+                {
+                  need_restart (w->name);
+                  continue;
+                }
+
+              path = ev->len ? dir_entry_name (w->name, ev->name) : w->name;
+              if (hash_find_item (&restart_names, path))
+                {
+                  need_restart (path);
+                  continue;
+                }
+
+              f = forget_mtime (path);
+              if (!ev->len || !(ev->mask & ENTRY_EVENTS))
+                continue;
+
+              /* A directory we watch by this name, or wait for, came or
+                 went.  */
+              key.name = path;
+              if ((ev->mask & IN_ISDIR)
+                  && hash_find_item (&watched_dirs, &key))
+                {
+                  need_restart (path);
+                  continue;
+                }
+
+              /* Whatever it is now, find out again.  */
+              for (; f != 0; f = f->prev)
+                f->watched = 0;
+
+              if (entry_event_count == entry_event_size)
+                {
+                  entry_event_size = entry_event_size
+                                     ? entry_event_size * 2 : 64;
+                  entry_events = xrealloc (entry_events, entry_event_size
+                                           * sizeof (struct entry_event));
+                }
+              entry_events[entry_event_count].dir = w->name;
+              entry_events[entry_event_count].name = strcache_add (ev->name);
+              ++entry_event_count;
+            }
+        }
+    }
+
+  for (i = 0; i < entry_event_count && !restart_pending; ++i)
+    check_entry (entry_events[i].dir, entry_events[i].name);
+  entry_event_count = 0;
+}
+
+/* Requests.  */
+
+static int
+volatile_env_p (const char *entry)
+{
+  const char *const *v;
+
+  for (v = volatile_env; *v != 0; ++v)
+    {
+      size_t len = strlen (*v);
+      if (strneq (entry, *v, len) && entry[len] == '=')
+        return 1;
+    }
+
+  return 0;
+}
+
+static int
+string_compare (const void *x, const void *y)
+{
+  return strcmp (*(char *const *) x, *(char *const *) y);
+}
+
+/* Return the environment ENV, without the entries that do not matter, in
+   sorted order.  Set *COUNT to the number of entries.  */
+
+static const char **
+sorted_env (char **env, unsigned int *count)
+{
+  const char **sorted;
+  unsigned int n = 0;
+  char **p;
+
+  for (p = env; *p != 0; ++p)
+    ++n;
+  sorted = xmalloc ((n + 1) * sizeof (char *));
+
+  n = 0;
+  for (p = env; *p != 0; ++p)
+    if (!volatile_env_p (*p))
+      sorted[n++] = *p;
+  qsort (sorted, n, sizeof (char *), string_compare);
+
+  *count = n;
+  return sorted;
+}
+
+/* Return nonzero if ARG is the --server or --client option.  */
+
+static int
+server_option_p (const char *arg)
+{
+  return (streq (arg, "--server") || strneq (arg, "--server=", 9)
+          || streq (arg, "--client") || strneq (arg, "--client=", 9));
+}
+
+/* Read a whole request from FD into a buffer, receiving the client's
+   standard descriptors into FDS.  Return the buffer, and its length in
+   *LEN, or null if the request did not come through.  */
+
+static char *
+read_request (int fd, int fds[3], size_t *len)
+{
+  char *buf;
+  size_t size = 4096, used = 0;
+  char control[CMSG_SPACE (3 * sizeof (int))];
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  ssize_t n;
+
+  fds[0] = fds[1] = fds[2] = -1;
+  buf = xmalloc (size);
+
+  memset (&msg, 0, sizeof (msg));
+  iov.iov_base = buf;
+  iov.iov_len = size;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof (control);
+
+  EINTRLOOP (n, recvmsg (fd, &msg, MSG_CMSG_CLOEXEC));
+  if (n <= 0)
+    {
+      free (buf);
+      return 0;
+    }
+  used = n;
+
+  for (cmsg = CMSG_FIRSTHDR (&msg); cmsg != 0; cmsg = CMSG_NXTHDR (&msg, cmsg))
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+        && cmsg->cmsg_len == CMSG_LEN (3 * sizeof (int)))
+      memcpy (fds, CMSG_DATA (cmsg), 3 * sizeof (int));
+
+  while (1)
+    {
+      if (used == size)
+        {
+          size *= 2;
+          buf = xrealloc (buf, size);
+        }
+      EINTRLOOP (n, read (fd, buf + used, size - used));
+      if (n < 0)
+        break;
+      if (n == 0)
+        {
+          *len = used;
+          return buf;
+        }
+      used += n;
+    }
+
+  free (buf);
+  return 0;
+}
+
+/* Return the next string of the request, or null if there is none.  */
+
+static const char *
+next_string (char **p, const char *end)
+{
+  char *s = *p;
+  char *nul;
+
+  if (s >= end)
+    return 0;
+  nul = memchr (s, '\0', end - s);
+  if (nul == 0)
+    return 0;
+  *p = nul + 1;
+  return s;
+}
+
+/* Return null if the request in BUF is one we can serve, or why not.  */
+
+static const char *
+check_request (char *buf, size_t len, const char *cwd)
+{
+  const char *end = buf + len;
+  const char *s;
+  char **env;
+  const char **ours, **theirs;
+  unsigned int n, i, j, our_count, their_count;
+  int same;
+
+  s = next_string (&buf, end);
+  if (s == 0 || !streq (s, REQUEST_MAGIC))
+    return _("bad request");
+
+  s = next_string (&buf, end);
+  if (s == 0 || !streq (s, cwd))
+    return _("the working directory differs");
+
+  s = next_string (&buf, end);
+  if (s == 0)
+    return _("bad request");
+  n = (unsigned int) strtoul (s, NULL, 10);
+  for (i = 0, j = 0; i < n; ++i, ++j)
+    {
+      s = next_string (&buf, end);
+      if (s == 0)
+        return _("bad request");
+      while (j < (unsigned int) server_argc && server_option_p (server_argv[j]))
+        ++j;
+      if (j == (unsigned int) server_argc || !streq (s, server_argv[j]))
+        return _("the arguments differ");
+    }
+  while (j < (unsigned int) server_argc && server_option_p (server_argv[j]))
+    ++j;
+  if (j != (unsigned int) server_argc)
+    return _("the arguments differ");
+
+  s = next_string (&buf, end);
+  if (s == 0)
+    return _("bad request");
+  n = (unsigned int) strtoul (s, NULL, 10);
+  env = xmalloc ((n + 1) * sizeof (char *));
+  for (i = 0; i < n; ++i)
+    {
+      env[i] = (char *) next_string (&buf, end);
+      if (env[i] == 0)
+        {
+          free (env);
+          return _("bad request");
+        }
+    }
+  env[n] = 0;
+
+  ours = sorted_env (server_env, &our_count);
+  theirs = sorted_env (env, &their_count);
+  same = our_count == their_count;
+  for (i = 0; same && i < our_count; ++i)
+    same = streq (ours[i], theirs[i]);
+  free (ours);
+  free (theirs);
+  free (env);
+
+  return same ? 0 : _("the environment differs");
+}
+
+/* Return nonzero if the process at the other end of CONN runs as our
+   user.  */
+
+static int
+same_user (int conn)
+{
+  struct ucred cred;
+  socklen_t len = sizeof (cred);
+
+  return (getsockopt (conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0
+          && cred.uid == geteuid ());
+}
+
+/* Tell the client on CONN that we won't serve it, and why.  */
+
+static void
+refuse (int conn, const char *why)
+{
+  DB (DB_BASIC, (_("Make server: refusing a request: %s.\n"), why));
+  write_all (conn, "refused ", 8);
+  write_all (conn, why, strlen (why));
+  write_all (conn, "\n", 1);
+  close (conn);
+}
+
+/* Update the goals for the client on CONN.  */
+
+static void
+serve_request (int conn, struct goaldep *goals, int status, const char *cwd)
+{
+  int fds[3];
+  const char *why;
+  char *buf;
+  size_t len;
+  int i;
+
+  buf = read_request (conn, fds, &len);
+  if (buf == 0 || fds[0] < 0 || fds[1] < 0 || fds[2] < 0)
+    why = _("incomplete request");
+  else
+    why = check_request (buf, len, cwd);
+  free (buf);
+
+  if (why != 0)
+    {
+      for (i = 0; i < 3; ++i)
+        if (fds[i] >= 0)
+          close (fds[i]);
+      refuse (conn, why);
+      return;
+    }
+
+  DB (DB_BASIC, (_("Make server: serving a request.\n")));
+
+  /* Our children are in our process group, if we could make one; the
+     client's interrupts are meant for them too.  */
+  reply (conn, "pid", getpgrp () == getpid () ? -(long) getpid ()
+                                              : (long) getpid ());
+
+  fflush (stdout);
+  fflush (stderr);
+  for (i = 0; i < 3; ++i)
+    {
+      saved_fds[i] = fcntl (i, F_DUPFD_CLOEXEC, 3);
+      dup2 (fds[i], i);
+      close (fds[i]);
+    }
+
+  client_fd = conn;
+  serving = 1;
+
+  reset_files ();
+  reset_state ();
+  clock_skew_detected = 0;
+  prefetch_mtimes (goals);
+
+  switch (update_goal_chain (goals))
+    {
+    case us_none:
+    case us_success:
+      break;
+    case us_question:
+      status = MAKE_TROUBLE;
+      break;
+    case us_failed:
+      status = MAKE_FAILURE;
+      break;
+    }
+
+  if (clock_skew_detected)
+    O (error, NILF,
+       _("warning:  Clock skew detected.  Your build may be incomplete."));
+
+  while (job_slots_used > 0)
+    reap_children (1, status != 0);
+  remove_intermediates (0);
+  discard_prefetched_mtimes ();
+  save_state ();
+
+  restore_std_fds ();
+  serving = 0;
+  client_fd = -1;
+  reply (conn, "exit", status);
+  close (conn);
+
+  /* The goals may have led to files and directories we did not know of.
+     Files found through vpath have new names, which cannot be undone.  */
+  if (rehashed_files != files_rehashed)
+    need_restart (_("a vpath search"));
+  else
+    add_watches ();
+}
+
+/* Set up serving goals with the database read from MAKEFILES.  STATUS is
+   the status a make that updated the goals successfully would exit with.
+   Never return.  */
+
+void
+serve (struct goaldep *goals, struct goaldep *makefiles, int status,
+       const char *cwd)
+{
+  struct goaldep *m;
+  FILE_TIMESTAMP *mtimes;
+  unsigned int n;
+
+  dir_record_queries = DIR_QUERY_BUILD;
+  files_rehashed = rehashed_files;
+
+  EINTRLOOP (inotify_fd, inotify_init1 (IN_NONBLOCK | IN_CLOEXEC));
+  if (inotify_fd < 0)
+    pfatal_with_name ("inotify_init1");
+
+  hash_init (&watched_dirs, 199,
+             watched_dir_hash_1, watched_dir_hash_2, watched_dir_hash_cmp);
+  hash_init (&restart_names, 199, name_hash_1, name_hash_2, name_hash_cmp);
+
+  for (m = makefiles; m != 0; m = m->next)
+    {
+      const char *dir = file_dir_name (m->file->name);
+      add_restart_name (m->file);
+      if (dir != 0)
+        watch_dir (dir);
+    }
+
+  /* What a fresh make would start updating the goals with.  */
+  map_files (save_file_state);
+
+  /* Anything could have changed while we were reading the makefiles.
+     Note the times of the makefiles before we start watching, and look
+     at them again after.  */
+  for (n = 0, m = makefiles; m != 0; m = m->next)
+    ++n;
+  mtimes = xmalloc ((n + 1) * sizeof (FILE_TIMESTAMP));
+  for (n = 0, m = makefiles; m != 0; m = m->next)
+    {
+      check_renamed (m->file);
+      mtimes[n++] = m->file->last_mtime;
+    }
+
+  if (add_watches ())
+    restart_server (client_fd, 0);
+
+  for (n = 0, m = makefiles; m != 0; m = m->next, ++n)
+    if (mtimes[n] != UNKNOWN_MTIME)
+      {
+        m->file->last_mtime = UNKNOWN_MTIME;
+        if (file_mtime_no_search (m->file) != mtimes[n])
+          restart_server (client_fd, 0);
+      }
+  free (mtimes);
+
+  {
+    char *fds;
+
+    for (n = 0; server_env[n] != 0; ++n)
+      ;
+    restart_env = xmalloc ((n + 2) * sizeof (char *));
+    memcpy (restart_env, server_env, n * sizeof (char *));
+    fds = xmalloc (CSTRLEN (SERVER_FDS_NAME) + 2 + 2 * INTSTR_LENGTH);
+    sprintf (fds, "%s=%d,-1", SERVER_FDS_NAME, listen_fd);
+    restart_env[n] = fds;
+    restart_env[n + 1] = 0;
+  }
+
+  /* Drop any recorded times from the state file now, before a request
+     can change the files they are for.  */
+  state_times = 0;
+  load_state ();
+  save_state ();
+
+  DB (DB_BASIC, (_("Make server: ready.\n")));
+
+  if (client_fd >= 0)
+    {
+      int conn = client_fd;
+      client_fd = -1;
+      serve_request (conn, goals, status, cwd);
+    }
+
+  while (1)
+    {
+      struct pollfd fds[2];
+      int n;
+
+      fds[0].fd = listen_fd;
+      fds[0].events = POLLIN;
+      fds[1].fd = inotify_fd;
+      fds[1].events = POLLIN;
+
+      n = poll (fds, 2, restart_pending ? RESTART_DELAY : -1);
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          pfatal_with_name ("poll");
+        }
+
+      /* Things have settled down; start over before the next request.  */
+      if (n == 0)
+        restart_server (-1, 0);
+
+      if (fds[1].revents & POLLIN)
+        read_events ();
+
+      if (fds[0].revents & POLLIN)
+        {
+          int conn;
+
+          EINTRLOOP (conn, accept4 (listen_fd, NULL, NULL, SOCK_CLOEXEC));
+          if (conn < 0)
+            continue;
+
+          if (!same_user (conn))
+            {
+              refuse (conn, _("another user is asking"));
+              continue;
+            }
+
+          /* Anything that changed before the request was made counts.  */
+          read_events ();
+          if (restart_pending)
+            restart_server (conn, 0);
+
+          serve_request (conn, goals, status, cwd);
+        }
+    }
+}
+
+/* Get ready to serve on the socket NAME, and read the makefiles in a way
+   that lets us tell later what changes matter.  ARGV and ENVP are what
+   main() was given.  */
+
+void
+prepare_server (const char *name, int argc, char **argv, char **envp)
+{
+  const char *fds = getenv (SERVER_FDS_NAME);
+  unsigned int n = 0;
+  char **p;
+
+  server_pid = getpid ();
+  setpgid (0, 0);
+
+  server_argc = argc;
+  server_argv = xmalloc ((argc + 1) * sizeof (char *));
+  memcpy (server_argv, argv, (argc + 1) * sizeof (char *));
+
+  /* Keep the environment we were started with, but not the descriptors a
+     previous server passed on to us; and don't pass those on to the
+     commands we run either.  */
+  for (p = envp; *p != 0; ++p)
+    ++n;
+  server_env = xmalloc ((n + 1) * sizeof (char *));
+  n = 0;
+  for (p = envp; *p != 0; ++p)
+    if (!strneq (*p, SERVER_FDS_NAME "=", CSTRLEN (SERVER_FDS_NAME) + 1))
+      server_env[n++] = *p;
+  server_env[n] = 0;
+
+  if (fds != 0)
+    {
+      char **q;
+      int lfd = -1, cfd = -1;
+
+      for (p = q = environ; *p != 0; ++p)
+        if (!strneq (*p, SERVER_FDS_NAME "=", CSTRLEN (SERVER_FDS_NAME) + 1))
+          *q++ = *p;
+      *q = 0;
+      undefine_variable_global (SERVER_FDS_NAME, CSTRLEN (SERVER_FDS_NAME),
+                                o_env);
+
+      /* If we were started again to rebuild a makefile, the descriptors
+         were closed; start from scratch then.  */
+      if (sscanf (fds, "%d,%d", &lfd, &cfd) == 2
+          && lfd >= 0 && fcntl (lfd, F_GETFD) >= 0)
+        {
+          listen_fd = lfd;
+          set_cloexec (listen_fd, 1);
+          if (cfd >= 0 && fcntl (cfd, F_GETFD) >= 0)
+            {
+              client_fd = cfd;
+              set_cloexec (client_fd, 1);
+            }
+        }
+    }
+
+  if (listen_fd < 0)
+    {
+      struct sockaddr_un addr;
+      mode_t mask;
+      int r;
+
+      if (strlen (name) >= sizeof (addr.sun_path))
+        OS (fatal, NILF, _("%s: socket name is too long"), name);
+
+      memset (&addr, 0, sizeof (addr));
+      addr.sun_family = AF_UNIX;
+      strcpy (addr.sun_path, name);
+
+      EINTRLOOP (listen_fd, socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+      if (listen_fd < 0)
+        pfatal_with_name ("socket");
+
+      /* The socket is ours alone from the moment it has a name.  */
+      mask = umask (0177);
+      EINTRLOOP (r, bind (listen_fd, (struct sockaddr *) &addr, sizeof (addr)));
+      if (r < 0 && errno == EADDRINUSE)
+        {
+          /* Only take the name over from a server that is gone.  */
+          int s;
+
+          EINTRLOOP (s, socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+          if (s >= 0)
+            {
+              EINTRLOOP (r, connect (s, (struct sockaddr *) &addr,
+                                     sizeof (addr)));
+              close (s);
+              if (r == 0)
+                OS (fatal, NILF,
+                    _("%s: a make server is already listening"), name);
+            }
+          unlink (name);
+          EINTRLOOP (r, bind (listen_fd, (struct sockaddr *) &addr,
+                              sizeof (addr)));
+        }
+      umask (mask);
+      if (r < 0)
+        pfatal_with_name (name);
+
+      if (listen (listen_fd, 16) < 0)
+        pfatal_with_name (name);
+    }
+
+  /* die() runs in the directory we started in.  */
+  if (name[0] == '/' || starting_directory == 0)
+    socket_path = xstrdup (name);
+  else
+    socket_path = xstrdup (concat (3, starting_directory, "/", name));
+
+  dir_record_queries = DIR_QUERY_PARSE;
+}
+
+/* Called from die(): if we were serving a request, give the client our exit
+   STATUS and start over, since what we have in memory may be in any state.
+   Otherwise remove the socket.  */
+
+void
+server_exit (int status)
+{
+  if (server_pid == 0 || server_pid != getpid ())
+    return;
+
+  if (serving)
+    {
+      restore_std_fds ();
+      reply (client_fd, "exit", status);
+      close (client_fd);
+      serving = 0;
+      restart_server (-1, restart_env);
+    }
+
+  if (socket_path != 0)
+    unlink (socket_path);
+}
+
+/* Called from fatal_error_signal() once the children are gone, before make
+   kills itself with SIG.  Tell the client, and start over.  */
+
+void
+server_signal (int sig)
+{
+  sigset_t set;
+
+  if (server_pid == 0 || server_pid != getpid ())
+    return;
+
+  if (!serving)
+    {
+      if (socket_path != 0)
+        unlink (socket_path);
+      return;
+    }
+
+  restore_std_fds ();
+  reply (client_fd, "signal", sig);
+  close (client_fd);
+
+  sigemptyset (&set);
+  sigaddset (&set, sig);
+  sigprocmask (SIG_UNBLOCK, &set, NULL);
+
+  restart_server (-1, restart_env);
+}
+
+/* The client.  */
+
+static volatile sig_atomic_t client_signal = 0;
+static volatile sig_atomic_t server_target = 0;
+
+static void
+forward_signal (int sig)
+{
+  client_signal = sig;
+  if (server_target != 0)
+    kill ((pid_t) server_target, sig);
+}
+
+static const int forwarded_signals[] = { SIGINT, SIGTERM, SIGHUP, SIGQUIT };
+#define FORWARDED_SIGNALS \
+  (sizeof (forwarded_signals) / sizeof (forwarded_signals[0]))
+
+/* Ask the server on the socket NAME to update the goals, and exit with its
+   status.  Return if there is no server, or it will not do it for us.  CWD,
+   ARGC, ARGV and ENVP describe the request.  */
+
+void
+run_client (const char *name, const char *cwd, int argc, char **argv,
+            char **envp)
+{
+  struct sockaddr_un addr;
+  struct sigaction sa, old[FORWARDED_SIGNALS];
+  struct msghdr msg;
+  struct iovec iov;
+  char control[CMSG_SPACE (3 * sizeof (int))];
+  struct cmsghdr *cmsg;
+  struct { char *buf; size_t len, size; } req = { 0, 0, 0 };
+  char line[256];
+  size_t have = 0;
+  int started = 0;
+  int fd, r, i, nargs, nenv;
+  char num[INTSTR_LENGTH + 1];
+  ssize_t n;
+
+  if (strlen (name) >= sizeof (addr.sun_path))
+    return;
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, name);
+
+  EINTRLOOP (fd, socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  if (fd < 0)
+    return;
+  EINTRLOOP (r, connect (fd, (struct sockaddr *) &addr, sizeof (addr)));
+  if (r < 0)
+    {
+      DB (DB_BASIC, (_("No make server at '%s'.\n"), name));
+      close (fd);
+      return;
+    }
+
+#define ADD(_s, _l)                                                     \
+  do {                                                                  \
+    size_t _n = (_l);                                                   \
+    if (req.len + _n > req.size)                                        \
+      {                                                                 \
+        req.size = (req.len + _n) * 2;                                  \
+        req.buf = xrealloc (req.buf, req.size);                         \
+      }                                                                 \
+    memcpy (req.buf + req.len, (_s), _n);                               \
+    req.len += _n;                                                      \
+  } while (0)
+
+  ADD (REQUEST_MAGIC, sizeof (REQUEST_MAGIC));
+  ADD (cwd, strlen (cwd) + 1);
+
+  for (i = 0, nargs = 0; i < argc; ++i)
+    if (!server_option_p (argv[i]))
+      ++nargs;
+  sprintf (num, "%d", nargs);
+  ADD (num, strlen (num) + 1);
+  for (i = 0; i < argc; ++i)
+    if (!server_option_p (argv[i]))
+      ADD (argv[i], strlen (argv[i]) + 1);
+
+  for (nenv = 0; envp[nenv] != 0; ++nenv)
+    ;
+  sprintf (num, "%d", nenv);
+  ADD (num, strlen (num) + 1);
+  for (i = 0; i < nenv; ++i)
+    ADD (envp[i], strlen (envp[i]) + 1);
+
+#undef ADD
+
+  /* Our standard descriptors go along with the first part.  */
+  memset (&msg, 0, sizeof (msg));
+  memset (control, 0, sizeof (control));
+  iov.iov_base = req.buf;
+  iov.iov_len = req.len;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof (control);
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (3 * sizeof (int));
+  for (i = 0; i < 3; ++i)
+    ((int *) CMSG_DATA (cmsg))[i] = i;
+
+  EINTRLOOP (n, sendmsg (fd, &msg, MSG_NOSIGNAL));
+  if (n < 0 || !write_all (fd, req.buf + n, req.len - n))
+    {
+      free (req.buf);
+      close (fd);
+      return;
+    }
+  free (req.buf);
+  shutdown (fd, SHUT_WR);
+
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = forward_signal;
+  sigemptyset (&sa.sa_mask);
+  for (i = 0; i < (int) FORWARDED_SIGNALS; ++i)
+    sigaction (forwarded_signals[i], &sa, &old[i]);
+
+  while (1)
+    {
+      char *nl;
+
+      n = read (fd, line + have, sizeof (line) - 1 - have);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      have += n;
+      line[have] = '\0';
+
+      while ((nl = strchr (line, '\n')) != 0)
+        {
+          long v;
+
+          *nl = '\0';
+          v = strtol (strchr (line, ' ') ? strchr (line, ' ') + 1 : "", NULL, 10);
+
+          if (strneq (line, "refused ", 8))
+            {
+              DB (DB_BASIC, (_("The make server refused the request: %s.\n"),
+                             line + 8));
+              goto local;
+            }
+          else if (strneq (line, "pid ", 4))
+            {
+              started = 1;
+              server_target = (sig_atomic_t) v;
+              if (client_signal != 0)
+                kill ((pid_t) v, client_signal);
+            }
+          else if (strneq (line, "exit ", 5))
+            {
+              close (fd);
+              die ((int) v);
+            }
+          else if (strneq (line, "signal ", 7))
+            {
+              close (fd);
+              signal ((int) v, SIG_DFL);
+              kill (getpid (), (int) v);
+              die (MAKE_TROUBLE);
+            }
+
+          have -= nl + 1 - line;
+          memmove (line, nl + 1, have + 1);
+        }
+    }
+
+  /* The server went away.  If it had not started on the request, we can
+     still update the goals ourselves.  */
+  if (started)
+    {
+      if (client_signal != 0)
+        {
+          signal (client_signal, SIG_DFL);
+          kill (getpid (), client_signal);
+        }
+      OS (fatal, NILF, _("%s: the make server went away"), name);
+    }
+
+ local:
+  close (fd);
+  for (i = 0; i < (int) FORWARDED_SIGNALS; ++i)
+    sigaction (forwarded_signals[i], &old[i], NULL);
+}
+
+#else /* !MAKE_SERVER */
+
+void
+prepare_server (const char *name UNUSED, int argc UNUSED, char **argv UNUSED,
+                char **envp UNUSED)
+{
+  O (fatal, NILF, _("--server is not supported on this platform"));
+}
+
+void
+run_client (const char *name UNUSED, const char *cwd UNUSED,
+            int argc UNUSED, char **argv UNUSED, char **envp UNUSED)
+{
+}
+
+void
+serve (struct goaldep *goals UNUSED, struct goaldep *makefiles UNUSED,
+       int status UNUSED, const char *cwd UNUSED)
+{
+  O (fatal, NILF, "INTERNAL: Cannot serve when --server is not supported");
+}
+
+void
+server_exit (int status UNUSED)
+{
+}
+
+void
+server_signal (int sig UNUSED)
+{
+}
+
+#endif /* MAKE_SERVER */
@@ -0,0 +1,2422 @@
+/* Persistent build state for Make+.
+This file is part of Make+.
+
+Make+ is free software; you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation; either version 3 of the License, or (at your option) any later
+version.
+
+Make+ is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+#include "makeint.h"
+#include "filedef.h"
+#include "dep.h"
+#include "variable.h"
+#include "job.h"
+#include "commands.h"
+#include "rule.h"
+#include "debug.h"
+
+#ifdef HAVE_FCNTL_H
+# include <fcntl.h>
+#else
+# include <sys/file.h>
+#endif
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+
+/* A makefile that names a state file with the .STATE_FILE special target
+   lets make carry what it learned about the targets over to the next run.
+   The state file records, for every target that has a recipe, its
+   modification time, and for every directory such targets are in, that
+   directory's device, inode, modification time and change time.
+
+   On the next run make stat()s each of those directories once.  If one is
+   unchanged, no entry has been added to it, removed from it or renamed in
+   it since the state was saved, and make uses the recorded times of the
+   targets in it instead of stat()ing them.  This assumes that targets are
+   only ever written by their recipes, or replaced as a whole; a target
+   that is changed in place behind make's back is not noticed until the
+   directory changes or make is run with --full-check.  Files without a
+   recipe, such as sources and headers, are always stat()ed, since they are
+   usually edited in place.
+
+   The recorded times are only used until make runs its first command.
+   Before it does, it truncates the state file, so that a run that is
+   interrupted while targets are being rebuilt leaves no stale state
+   behind; the state is saved again once the goals have been updated.  The
+   file is rewritten in place rather than replaced, so that saving it does
+   not change the directory it is in.
+
+   With the .HASHCHECK special target, the state file also lets make tell
+   a prerequisite that was changed from one that was merely touched, as
+   happens to many files at once when switching branches in a version
+   control system or restoring files from a cache.  For each target with a
+   recipe, it records the target's modification time and a digest of the
+   contents of those of its prerequisites that are compared by content
+   (all of them, if .HASHCHECK has no prerequisites), as they were when
+   the target was last found up to date.  A target that looks out of date
+   only because such prerequisites are newer is left alone if it has not
+   changed since the record was made and the digest still matches.  The
+   digest of each prerequisite is recorded as well, with its size and
+   modification time, and is only computed again when either of those
+   changes.  These records remain true when commands are run, so they are
+   kept when the state file is emptied; without .STATE_FILE they are all
+   the state file holds.
+
+   A target listed in .RESTAT (or any target, if .RESTAT has no
+   prerequisites) is looked at again after its recipe has run.  If the
+   recipe did not touch it, or wrote it out with the same contents, make
+   takes it as unchanged: it keeps the modification time it had before, so
+   that the targets that depend on it are not remade for its sake.  The
+   state file records the time the file really has, the time it is taken
+   to have, and the time of its newest prerequisite when the recipe ran, so
+   that the file keeps its old time in later runs and its recipe is not
+   run again until one of its prerequisites changes.
+
+   For a target listed in .CMDCHECK (or any target, if .CMDCHECK has no
+   prerequisites), the state file records a digest of the recipe that
+   last made it, as expanded for that target.  A target whose recipe now
+   expands differently, because a variable such as CFLAGS was changed, is
+   remade even though it is newer than its prerequisites.  A target made
+   before its recipe was first recorded is taken to have been made by the
+   recipe it has now.  The recipe is expanded without running the functions
+   that act on the world ($(shell), $(info), $(warning), $(error), $(eval),
+   $(file) and loaded functions), so that up to date targets cost nothing
+   but the expansion.  A recipe that calls one of them is recorded as it is
+   written instead, so a change that reaches it only through such a call,
+   say a variable set from $(shell ...), is not noticed.
+
+   For a target listed in .RULECACHE (or any target, if .RULECACHE has no
+   prerequisites) that make has to find an implicit rule for, the state
+   file records the outcome of the search: the pattern rule target it
+   chose, or that no rule applies, and every directory the search looked
+   in for a prerequisite.  The next run takes the outcome from the record
+   instead of searching again, as long as the pattern rules and the names
+   of the files that make knows of are the same as they were, and none of
+   those directories has changed.  Since a file that make knows of counts
+   as existing, searches are neither recorded nor replayed once one has
+   entered a file that need not exist, such as an intermediate file; nor
+   once commands have been run; nor at all with search paths or secondary
+   expansion, whose outcomes depend on more than this.  */
+
+/* Name of the state file, or null if the makefiles don't ask for one.  */
+
+const char *state_file_name = 0;
+
+/* Nonzero if the state file records timestamps (.STATE_FILE), digests
+   (.HASHCHECK), unchanged targets (.RESTAT), recipes (.CMDCHECK) and
+   implicit rule searches (.RULECACHE).  */
+
+int state_times = 0;
+int state_hashes = 0;
+int state_restat = 0;
+int state_commands = 0;
+int state_rules = 0;
+
+/* Nonzero if .HASHCHECK has no prerequisites: all files are compared by
+   content.  */
+
+int hash_check_all = 0;
+
+/* Nonzero if .RESTAT has no prerequisites: all targets are looked at again
+   after their recipes have run.  */
+
+int restat_all = 0;
+
+/* Nonzero if .CMDCHECK has no prerequisites: the recipes of all targets
+   are recorded.  */
+
+int cmd_check_all = 0;
+
+/* Nonzero if .RULECACHE has no prerequisites: the implicit rule searches
+   for all targets are recorded.  */
+
+int rule_cache_all = 0;
+
+/* First line of the state file.  The number of fraction bits in a
+   FILE_TIMESTAMP is part of it, since the recorded times are raw
+   FILE_TIMESTAMP values.  */
+
+#define STATE_MAGIC     "# Make+ state 1 "
+
+/* Last line of the state file; a file without it was not written out
+   completely.  */
+
+#define STATE_END       "end\n"
+
+struct state_dir
+  {
+    const char *name;           /* Name of the directory (strcache'd).  */
+    uintmax_t dev;
+    uintmax_t ino;
+    FILE_TIMESTAMP mtime;
+    uintmax_t ctime;            /* Change time, in seconds.  */
+    unsigned int valid:1;       /* Nonzero if the members are up to date.  */
+    unsigned int stat_ok:1;     /* Nonzero if the directory exists.  */
+    unsigned int unchanged:1;   /* Nonzero if it matched the state file.  */
+    unsigned int num;           /* Its number in the state file, plus one,
+                                   while that is written.  */
+  };
+
+struct state_entry
+  {
+    const char *name;           /* Name of the target (strcache'd).  */
+    FILE_TIMESTAMP mtime;
+  };
+
+/* The digest of the contents of a file.  */
+
+struct state_digest
+  {
+    const char *name;           /* Name of the file (strcache'd).  */
+    uintmax_t size;
+    FILE_TIMESTAMP mtime;
+    uint64_t digest;
+    time_t sec;                 /* Modtime, as read by read_digest().  */
+    long int ns;
+    int err;                    /* errno from read_digest(), or zero.  */
+    unsigned int known:1;       /* Nonzero if the members are usable.  */
+    unsigned int checked:1;     /* Nonzero if compared with the file.  */
+    unsigned int queued:1;      /* Nonzero if about to be.  */
+    unsigned int hashed:1;      /* Nonzero if the contents were read.  */
+  };
+
+/* The digest of the prerequisites of a target that are compared by
+   content, as they were when the target had modification time MTIME.  */
+
+struct state_target
+  {
+    const char *name;           /* Name of the target (strcache'd).  */
+    FILE_TIMESTAMP mtime;
+    uint64_t digest;
+  };
+
+/* A .RESTAT target that the last run of its recipe left unchanged.  It has
+   modification time DISK, but is taken to have MTIME, and its prerequisites
+   were no newer than INPUTS when the recipe ran.  */
+
+struct state_restat
+  {
+    const char *name;           /* Name of the target (strcache'd).  */
+    FILE_TIMESTAMP disk;
+    FILE_TIMESTAMP mtime;
+    FILE_TIMESTAMP inputs;
+    FILE_TIMESTAMP old_disk;    /* The times before the recipe ran.  */
+    FILE_TIMESTAMP old_mtime;
+    uint64_t old_digest;        /* The digest before the recipe ran.  */
+    unsigned int valid:1;       /* Nonzero if DISK, MTIME and INPUTS are set.  */
+    unsigned int active:1;      /* Nonzero if the file has time DISK.  */
+    unsigned int running:1;     /* Nonzero while the recipe runs.  */
+    unsigned int have_digest:1; /* Nonzero if OLD_DIGEST is set.  */
+  };
+
+/* The digest of the recipe that last made a .CMDCHECK target, and of the
+   recipe it has now.  */
+
+struct state_recipe
+  {
+    const char *name;           /* Name of the target (strcache'd).  */
+    uint64_t digest;
+    uint64_t current;
+    unsigned int valid:1;       /* Nonzero if DIGEST is set.  */
+    unsigned int have_current:1; /* Nonzero if CURRENT is set.  */
+  };
+
+/* The outcome of the implicit rule search for a .RULECACHE target: the
+   number of the pattern rule target it chose, plus one, or zero if no rule
+   applied, and the directories the search looked in.  */
+
+struct state_search
+  {
+    const char *name;           /* Name of the target (strcache'd).  */
+    unsigned int found;
+    unsigned int ndirs;
+    struct state_dir **dirs;
+  };
+
+static struct hash_table state_dirs;
+static struct hash_table state_entries;
+static struct hash_table state_digests;
+static struct hash_table state_targets;
+static struct hash_table state_restats;
+static struct hash_table state_recipes;
+static struct hash_table state_searches;
+
+/* The directories that implicit rule searches looked in, as they were when
+   this run started.  They are kept apart from STATE_DIRS, which are looked
+   at again once commands have run.  */
+static struct hash_table search_dirs;
+
+/* The digest of the pattern rules and the names of the known files that
+   the recorded searches were made with, if SEARCHES_KEYED.  */
+static uint64_t searches_key;
+static int searches_keyed = 0;
+
+/* Nonzero once the key has been worked out for this run.  */
+static int rules_digested = 0;
+
+/* Nonzero once searches can no longer be recorded or replayed.  */
+static int searches_stopped = 0;
+
+/* The target whose search is being recorded, if any, and the directories
+   the search has looked in so far.  */
+static struct file *search_file;
+static struct state_dir **search_list;
+static unsigned int search_count;
+static unsigned int search_size;
+
+/* Nonzero once the state file has been read.  */
+static int state_loaded = 0;
+
+/* Nonzero once a command has been started this run.  */
+static int state_invalidated = 0;
+
+/* Nonzero once all the recorded digests have been compared with the
+   files.  */
+static int digests_verified = 0;
+
+/* Nonzero while the state is being saved, once no more commands can
+   change the files.  */
+static int digests_final = 0;
+
+/* Nonzero if the state on disk is known to be out of date.  */
+static int state_dirty = 0;
+
+static unsigned long
+state_dir_hash_1 (const void *key)
+{
+  return_ISTRING_HASH_1 (((const struct state_dir *) key)->name);
+}
+
+static unsigned long
+state_dir_hash_2 (const void *key)
+{
+  return_ISTRING_HASH_2 (((const struct state_dir *) key)->name);
+}
+
+static int
+state_dir_hash_cmp (const void *x, const void *y)
+{
+  return_ISTRING_COMPARE (((const struct state_dir *) x)->name,
+                          ((const struct state_dir *) y)->name);
+}
+
+/* Entries are looked up by the strcache'd name of the target.  So are
+   digests and target records, which start with the name as well.  */
+
+static unsigned long
+state_entry_hash_1 (const void *key)
+{
+  return_ADDRESS_HASH_1 (((const struct state_entry *) key)->name);
+}
+
+static unsigned long
+state_entry_hash_2 (const void *key)
+{
+  return_ADDRESS_HASH_2 (((const struct state_entry *) key)->name);
+}
+
+static int
+state_entry_hash_cmp (const void *x, const void *y)
+{
+  return_ADDRESS_COMPARE (((const struct state_entry *) x)->name,
+                          ((const struct state_entry *) y)->name);
+}
+
+/* Return nonzero if the modification time of FILE is worth recording.  */
+
+static int
+recordable_file (const struct file *file)
+{
+  return (file->is_target && file->cmds != 0 && !file->phony
+          && file->double_colon == 0 && file->name == file->hname
+          && strchr (file->name, '\n') == 0
+#ifndef NO_ARCHIVES
+          && !ar_name (file->name)
+#endif
+          );
+}
+
+/* Return nonzero if FILE is compared by content.  */
+
+static int
+hash_checked (const struct file *file)
+{
+  return (hash_check_all || file->hash_check) && !file->phony;
+}
+
+/* Return nonzero if FILE is looked at again after its recipe has run.  */
+
+static int
+restat_checked (const struct file *file)
+{
+  return (restat_all || file->restat) && recordable_file (file);
+}
+
+/* Return nonzero if the recipe that made FILE is recorded.  */
+
+static int
+cmd_checked (const struct file *file)
+{
+  return (cmd_check_all || file->cmd_check) && recordable_file (file);
+}
+
+/* Return nonzero if the implicit rule search for FILE is recorded.  */
+
+static int
+rule_cached (const struct file *file)
+{
+  return ((rule_cache_all || file->rule_cache) && !file->phony
+          && file->name == file->hname && strchr (file->name, '\n') == 0
+#ifndef NO_ARCHIVES
+          && !ar_name (file->name)
+#endif
+          );
+}
+
+/* Return the directory part of NAME, in the strcache.  */
+
+static const char *
+state_dir_name (const char *name)
+{
+  const char *slash = strrchr (name, '/');
+
+  if (slash == 0)
+    return strcache_add (".");
+  if (slash == name)
+    return strcache_add ("/");
+  return strcache_add_len (name, slash - name);
+}
+
+/* Find the entry for directory NAME, entering it if CREATE.  */
+
+static struct state_dir *
+find_state_dir (const char *name, int create)
+{
+  struct state_dir key;
+  struct state_dir **slot;
+  struct state_dir *sd;
+
+  key.name = name;
+  slot = (struct state_dir **) hash_find_slot (&state_dirs, &key);
+  sd = *slot;
+  if (HASH_VACANT (sd) && create)
+    {
+      sd = xcalloc (sizeof (struct state_dir));
+      sd->name = strcache_add (name);
+      hash_insert_at (&state_dirs, sd, slot);
+    }
+  return HASH_VACANT (sd) ? 0 : sd;
+}
+
+/* Fill in *SD from the directory itself.  */
+
+static void
+stat_state_dir (struct state_dir *sd)
+{
+  struct stat st;
+  int e;
+
+  EINTRLOOP (e, stat (sd->name, &st));
+  sd->stat_ok = e == 0;
+  if (e != 0)
+    return;
+
+  sd->dev = st.st_dev;
+  sd->ino = st.st_ino;
+  sd->mtime = FILE_TIMESTAMP_STAT_MODTIME (sd->name, st);
+  sd->ctime = st.st_ctime;
+}
+
+/* Find the directory NAME that searches looked in, entering it if
+   CREATE.  */
+
+static struct state_dir *
+find_search_dir (const char *name, int create)
+{
+  struct state_dir key;
+  struct state_dir **slot;
+  struct state_dir *sd;
+
+  key.name = name;
+  slot = (struct state_dir **) hash_find_slot (&search_dirs, &key);
+  sd = *slot;
+  if (HASH_VACANT (sd) && create)
+    {
+      sd = xcalloc (sizeof (struct state_dir));
+      sd->name = strcache_add (name);
+      hash_insert_at (&search_dirs, sd, slot);
+    }
+  return HASH_VACANT (sd) ? 0 : sd;
+}
+
+/* Forget what is known about a directory.  */
+
+static void
+invalidate_state_dir (const void *item)
+{
+  struct state_dir *sd = (struct state_dir *) item;
+  sd->valid = sd->unchanged = 0;
+}
+
+/* Find the digest of file NAME, a name from the strcache, entering it if
+   CREATE.  */
+
+static struct state_digest *
+find_digest (const char *name, int create)
+{
+  struct state_digest key;
+  struct state_digest **slot;
+  struct state_digest *dg;
+
+  key.name = name;
+  slot = (struct state_digest **) hash_find_slot (&state_digests, &key);
+  dg = *slot;
+  if (HASH_VACANT (dg) && create)
+    {
+      dg = xcalloc (sizeof (struct state_digest));
+      dg->name = name;
+      hash_insert_at (&state_digests, dg, slot);
+    }
+  return HASH_VACANT (dg) ? 0 : dg;
+}
+
+/* Find the record of .RESTAT target NAME, a name from the strcache,
+   entering it if CREATE.  */
+
+static struct state_restat *
+find_restat (const char *name, int create)
+{
+  struct state_restat key;
+  struct state_restat **slot;
+  struct state_restat *rs;
+
+  key.name = name;
+  slot = (struct state_restat **) hash_find_slot (&state_restats, &key);
+  rs = *slot;
+  if (HASH_VACANT (rs) && create)
+    {
+      rs = xcalloc (sizeof (struct state_restat));
+      rs->name = name;
+      hash_insert_at (&state_restats, rs, slot);
+    }
+  return HASH_VACANT (rs) ? 0 : rs;
+}
+
+/* Find the recipe record of target NAME, a name from the strcache, entering
+   it if CREATE.  */
+
+static struct state_recipe *
+find_recipe (const char *name, int create)
+{
+  struct state_recipe key;
+  struct state_recipe **slot;
+  struct state_recipe *rc;
+
+  key.name = name;
+  slot = (struct state_recipe **) hash_find_slot (&state_recipes, &key);
+  rc = *slot;
+  if (HASH_VACANT (rc) && create)
+    {
+      rc = xcalloc (sizeof (struct state_recipe));
+      rc->name = name;
+      hash_insert_at (&state_recipes, rc, slot);
+    }
+  return HASH_VACANT (rc) ? 0 : rc;
+}
+
+/* Find the search record of target NAME, a name from the strcache, entering
+   it if CREATE.  */
+
+static struct state_search *
+find_search (const char *name, int create)
+{
+  struct state_search key;
+  struct state_search **slot;
+  struct state_search *ss;
+
+  key.name = name;
+  slot = (struct state_search **) hash_find_slot (&state_searches, &key);
+  ss = *slot;
+  if (HASH_VACANT (ss) && create)
+    {
+      ss = xcalloc (sizeof (struct state_search));
+      ss->name = name;
+      hash_insert_at (&state_searches, ss, slot);
+    }
+  return HASH_VACANT (ss) ? 0 : ss;
+}
+
+static void
+free_search (const void *item)
+{
+  struct state_search *ss = (struct state_search *) item;
+  free (ss->dirs);
+  free (ss);
+}
+
+/* The digests are 64-bit XXH64 hashes.  The input is taken 32 bytes at a
+   time by four independent lanes, which the compiler can keep in registers
+   and the processor can work on side by side, so hashing a file takes
+   little longer than reading it.  */
+
+#define DIGEST_PRIME_1  UINT64_C (0x9E3779B185EBCA87)
+#define DIGEST_PRIME_2  UINT64_C (0xC2B2AE3D27D4EB4F)
+#define DIGEST_PRIME_3  UINT64_C (0x165667B19E3779F9)
+#define DIGEST_PRIME_4  UINT64_C (0x85EBCA77C2B2AE63)
+#define DIGEST_PRIME_5  UINT64_C (0x27D4EB2F165667C5)
+
+#define ROTL64(_x, _r)  (((_x) << (_r)) | ((_x) >> (64 - (_r))))
+
+struct digest
+  {
+    uint64_t lane[4];
+    uint64_t total;             /* Number of bytes seen so far.  */
+    unsigned char buf[32];      /* The bytes not taken by the lanes yet.  */
+    unsigned int used;
+  };
+
+static uint64_t
+read_le64 (const unsigned char *p)
+{
+  return ((uint64_t) p[0] | (uint64_t) p[1] << 8 | (uint64_t) p[2] << 16
+          | (uint64_t) p[3] << 24 | (uint64_t) p[4] << 32
+          | (uint64_t) p[5] << 40 | (uint64_t) p[6] << 48
+          | (uint64_t) p[7] << 56);
+}
+
+static uint64_t
+digest_round (uint64_t acc, uint64_t input)
+{
+  acc += input * DIGEST_PRIME_2;
+  acc = ROTL64 (acc, 31);
+  return acc * DIGEST_PRIME_1;
+}
+
+static void
+digest_init (struct digest *ds)
+{
+  ds->lane[0] = DIGEST_PRIME_1 + DIGEST_PRIME_2;
+  ds->lane[1] = DIGEST_PRIME_2;
+  ds->lane[2] = 0;
+  ds->lane[3] = (uint64_t) 0 - DIGEST_PRIME_1;
+  ds->total = 0;
+  ds->used = 0;
+}
+
+/* Feed the lanes LEN bytes at P; LEN is a multiple of 32.  */
+
+static void
+digest_stripes (struct digest *ds, const unsigned char *p, size_t len)
+{
+  uint64_t v0 = ds->lane[0];
+  uint64_t v1 = ds->lane[1];
+  uint64_t v2 = ds->lane[2];
+  uint64_t v3 = ds->lane[3];
+  const unsigned char *end = p + len;
+
+  for (; p < end; p += 32)
+    {
+      v0 = digest_round (v0, read_le64 (p));
+      v1 = digest_round (v1, read_le64 (p + 8));
+      v2 = digest_round (v2, read_le64 (p + 16));
+      v3 = digest_round (v3, read_le64 (p + 24));
+    }
+
+  ds->lane[0] = v0;
+  ds->lane[1] = v1;
+  ds->lane[2] = v2;
+  ds->lane[3] = v3;
+}
+
+static void
+digest_update (struct digest *ds, const void *data, size_t len)
+{
+  const unsigned char *p = data;
+  size_t n;
+
+  ds->total += len;
+
+  if (ds->used > 0)
+    {
+      n = sizeof (ds->buf) - ds->used;
+      if (n > len)
+        n = len;
+      memcpy (ds->buf + ds->used, p, n);
+      ds->used += n;
+      p += n;
+      len -= n;
+      if (ds->used < sizeof (ds->buf))
+        return;
+      digest_stripes (ds, ds->buf, sizeof (ds->buf));
+      ds->used = 0;
+    }
+
+  n = len & ~(size_t) 31;
+  digest_stripes (ds, p, n);
+  memcpy (ds->buf, p + n, len - n);
+  ds->used = len - n;
+}
+
+static uint64_t
+digest_final (const struct digest *ds)
+{
+  const unsigned char *p = ds->buf;
+  const unsigned char *end = p + ds->used;
+  uint64_t h;
+  int i;
+
+  if (ds->total >= sizeof (ds->buf))
+    {
+      h = (ROTL64 (ds->lane[0], 1) + ROTL64 (ds->lane[1], 7)
+           + ROTL64 (ds->lane[2], 12) + ROTL64 (ds->lane[3], 18));
+      for (i = 0; i < 4; ++i)
+        {
+          h ^= digest_round (0, ds->lane[i]);
+          h = h * DIGEST_PRIME_1 + DIGEST_PRIME_4;
+        }
+    }
+  else
+    h = DIGEST_PRIME_5;
+  h += ds->total;
+
+  for (; p + 8 <= end; p += 8)
+    {
+      h ^= digest_round (0, read_le64 (p));
+      h = ROTL64 (h, 27) * DIGEST_PRIME_1 + DIGEST_PRIME_4;
+    }
+  if (p + 4 <= end)
+    {
+      h ^= ((uint64_t) p[0] | (uint64_t) p[1] << 8 | (uint64_t) p[2] << 16
+            | (uint64_t) p[3] << 24) * DIGEST_PRIME_1;
+      h = ROTL64 (h, 23) * DIGEST_PRIME_2 + DIGEST_PRIME_3;
+      p += 4;
+    }
+  for (; p < end; ++p)
+    {
+      h ^= *p * DIGEST_PRIME_5;
+      h = ROTL64 (h, 11) * DIGEST_PRIME_1;
+    }
+
+  h ^= h >> 33;
+  h *= DIGEST_PRIME_2;
+  h ^= h >> 29;
+  h *= DIGEST_PRIME_3;
+  h ^= h >> 32;
+  return h;
+}
+
+/* Size of the buffer files are read into.  */
+#define DIGEST_BUFSIZ   65536
+
+/* Compare DG with the file it is for, and hash the contents unless the
+   size and modification time are the same as before.  This may run in any
+   thread, so it only looks at the file and at DG.  */
+
+static void
+read_digest (struct state_digest *dg)
+{
+  char buf[DIGEST_BUFSIZ];
+  struct digest ds;
+  struct stat st;
+  ssize_t n;
+  int fd, e;
+
+  EINTRLOOP (e, stat (dg->name, &st));
+  if (e != 0 || !S_ISREG (st.st_mode))
+    {
+      dg->err = e != 0 ? errno : EINVAL;
+      return;
+    }
+
+  dg->err = 0;
+  if (dg->known && dg->size == (uintmax_t) st.st_size
+      && dg->sec == st.st_mtime
+#if FILE_TIMESTAMP_HI_RES
+      && dg->ns == st.ST_MTIM_NSEC
+#endif
+      )
+    return;
+
+  dg->size = st.st_size;
+  dg->sec = st.st_mtime;
+#if FILE_TIMESTAMP_HI_RES
+  dg->ns = st.ST_MTIM_NSEC;
+#else
+  dg->ns = 0;
+#endif
+
+  EINTRLOOP (fd, open (dg->name, O_RDONLY));
+  if (fd < 0)
+    {
+      dg->err = errno;
+      return;
+    }
+
+  digest_init (&ds);
+  while (1)
+    {
+      EINTRLOOP (n, read (fd, buf, sizeof (buf)));
+      if (n <= 0)
+        break;
+      digest_update (&ds, buf, n);
+    }
+  if (n < 0)
+    dg->err = errno;
+  close (fd);
+
+  dg->digest = digest_final (&ds);
+  dg->hashed = 1;
+}
+
+#ifdef HAVE_PTHREAD
+
+/* Don't bother starting threads for fewer files than this.  */
+#define DIGEST_MIN      16
+
+/* Number of threads, including the main one.  */
+#define DIGEST_THREADS  8
+
+/* Number of files a thread takes from the queue at once.  */
+#define DIGEST_CHUNK    4
+
+static struct state_digest **digest_queue;
+static unsigned int digest_count;
+static unsigned int digest_next;
+static pthread_mutex_t digest_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Thread body: read digests from the queue until it is empty.  */
+
+static void *
+read_digests (void *arg UNUSED)
+{
+  while (1)
+    {
+      unsigned int i, end;
+
+      pthread_mutex_lock (&digest_lock);
+      i = digest_next;
+      end = i + DIGEST_CHUNK < digest_count ? i + DIGEST_CHUNK : digest_count;
+      digest_next = end;
+      pthread_mutex_unlock (&digest_lock);
+
+      if (i == end)
+        return 0;
+
+      for (; i < end; ++i)
+        read_digest (digest_queue[i]);
+    }
+}
+
+#endif /* HAVE_PTHREAD */
+
+/* Bring the COUNT digests in LIST up to date, with a pool of threads if
+   there are enough of them.  */
+
+static void
+check_digests (struct state_digest **list, unsigned int count)
+{
+  unsigned int nthreads = 0;
+  unsigned int hashed = 0;
+  unsigned int i;
+
+  /* read_digest() compares the modification time as stat() returns it.  */
+  for (i = 0; i < count; ++i)
+    if (list[i]->known)
+      {
+        list[i]->sec = FILE_TIMESTAMP_S (list[i]->mtime);
+        list[i]->ns = FILE_TIMESTAMP_NS (list[i]->mtime);
+      }
+
+#ifdef HAVE_PTHREAD
+  if (count >= DIGEST_MIN)
+    {
+      pthread_t threads[DIGEST_THREADS - 1];
+      sigset_t all, old;
+
+      digest_queue = list;
+      digest_count = count;
+      digest_next = 0;
+
+      /* The threads must not take any of our signals.  */
+      sigfillset (&all);
+      pthread_sigmask (SIG_SETMASK, &all, &old);
+      while (nthreads < DIGEST_THREADS - 1
+             && pthread_create (&threads[nthreads], 0, read_digests, 0) == 0)
+        ++nthreads;
+      pthread_sigmask (SIG_SETMASK, &old, 0);
+
+      read_digests (0);
+      for (i = 0; i < nthreads; ++i)
+        pthread_join (threads[i], 0);
+    }
+  else
+#endif
+    for (i = 0; i < count; ++i)
+      read_digest (list[i]);
+
+  for (i = 0; i < count; ++i)
+    {
+      struct state_digest *dg = list[i];
+
+      dg->checked = 1;
+      dg->queued = 0;
+      dg->known = dg->err == 0;
+      if (!dg->known)
+        continue;
+
+      dg->mtime = file_timestamp_cons (dg->name, dg->sec, dg->ns);
+      if (dg->hashed)
+        {
+          dg->hashed = 0;
+          ++hashed;
+          state_dirty = 1;
+        }
+    }
+
+  if (count > 1)
+    DB (DB_VERBOSE, (_("Hashed %u of %u files using %u threads.\n"),
+                     hashed, count, nthreads + 1));
+}
+
+/* Return the digest of FILE as it is now, or null if it can't be had.  */
+
+static struct state_digest *
+current_digest (struct file *file)
+{
+  struct state_digest *dg = find_digest (file->name, 1);
+
+  /* Until commands can no longer run, a file that make has seen change
+     since its digest was checked must be checked again.  */
+  if (!dg->checked
+      || (!digests_final && (!dg->known || dg->mtime != file->last_mtime)))
+    check_digests (&dg, 1);
+
+  return dg->known ? dg : 0;
+}
+
+/* Store the digest of the prerequisites of FILE that are compared by
+   content, and of their names, in *DIGEST.  Return zero if there are none,
+   or if FILE is out of date for some other reason: some prerequisite is
+   missing, or is newer than MTIME without being compared by content.  */
+
+static int
+deps_digest (struct file *file, FILE_TIMESTAMP mtime, uint64_t *digest)
+{
+  struct digest ds;
+  struct dep amake;
+  struct dep *ad;
+  int found = 0;
+
+  digest_init (&ds);
+
+  amake.file = file;
+  amake.next = file->also_make;
+  for (ad = &amake; ad != 0; ad = ad->next)
+    {
+      struct dep *d;
+
+      for (d = ad->file->deps; d != 0; d = d->next)
+        {
+          struct file *df = d->file;
+          struct state_digest *dg;
+          unsigned char buf[8];
+          FILE_TIMESTAMP d_mtime;
+          int i;
+
+          if (d->ignore_mtime)
+            continue;
+
+          check_renamed (df);
+          d_mtime = file_mtime (df);
+          if (d_mtime < ORDINARY_MTIME_MIN || d_mtime > ORDINARY_MTIME_MAX)
+            return 0;
+
+          if (!hash_checked (df))
+            {
+              if (d_mtime > mtime)
+                return 0;
+              continue;
+            }
+
+          dg = current_digest (df);
+          if (dg == 0)
+            return 0;
+
+          for (i = 0; i < 8; ++i)
+            buf[i] = (unsigned char) (dg->digest >> (i * 8));
+          digest_update (&ds, df->name, strlen (df->name) + 1);
+          digest_update (&ds, buf, sizeof (buf));
+          found = 1;
+        }
+    }
+
+  *digest = digest_final (&ds);
+  return found;
+}
+
+/* Store the time of the newest prerequisite of FILE in *NEWEST.  Return
+   zero if some prerequisite is missing or has no ordinary time.  */
+
+static int
+newest_prereq (struct file *file, FILE_TIMESTAMP *newest)
+{
+  struct dep amake;
+  struct dep *ad;
+
+  *newest = ORDINARY_MTIME_MIN;
+
+  amake.file = file;
+  amake.next = file->also_make;
+  for (ad = &amake; ad != 0; ad = ad->next)
+    {
+      struct dep *d;
+
+      for (d = ad->file->deps; d != 0; d = d->next)
+        {
+          struct file *df = d->file;
+          FILE_TIMESTAMP d_mtime;
+
+          if (d->ignore_mtime)
+            continue;
+
+          check_renamed (df);
+          d_mtime = file_mtime (df);
+          if (d_mtime < ORDINARY_MTIME_MIN || d_mtime > ORDINARY_MTIME_MAX)
+            return 0;
+          if (d_mtime > *newest)
+            *newest = d_mtime;
+        }
+    }
+
+  return 1;
+}
+
+/* Read a decimal number at *P and step past it and the blank after it.
+   Return nonzero if there was one.  */
+
+static int
+read_number (char **p, uintmax_t *n)
+{
+  char *s = *p;
+
+  if (!ISDIGIT (*s))
+    return 0;
+
+  *n = 0;
+  while (ISDIGIT (*s))
+    *n = *n * 10 + (*s++ - '0');
+  if (*s == ' ')
+    ++s;
+  else if (*s != '\0')
+    return 0;
+
+  *p = s;
+  return 1;
+}
+
+static void
+write_number (FILE *fp, uintmax_t n)
+{
+  char buf[INTSTR_LENGTH];
+  char *p = buf + sizeof (buf);
+
+  *--p = '\0';
+  do
+    *--p = '0' + n % 10;
+  while ((n /= 10) != 0);
+
+  fputs (p, fp);
+}
+
+/* The directories of the "p" lines read so far, in order.  */
+
+static struct state_dir **parsed_dirs;
+static unsigned int parsed_count;
+static unsigned int parsed_size;
+
+/* Parse the state in BUF, which is LEN bytes long and ends in a newline.
+   WRITTEN is the time the state file was last written.  The recorded
+   times are skipped unless USE_TIMES.  Return the number of targets whose
+   recorded times can be used, or -1 if BUF is not a complete state.  */
+
+static int
+parse_state (char *buf, size_t len, FILE_TIMESTAMP written, int use_times)
+{
+  char *p = buf;
+  char *end = buf + len;
+  struct state_dir *sd = 0;
+  int in_dir = 0;
+  uintmax_t bits;
+  int trusted = 0;
+
+  /* A directory that changed in the last second before the state was
+     written may have changed again since, within the granularity of its
+     time stamp, without the time stamp showing it.  */
+  FILE_TIMESTAMP racy = written - ((FILE_TIMESTAMP) 1
+                                   << FILE_TIMESTAMP_LO_BITS);
+
+  if (len < sizeof (STATE_END) - 1
+      || memcmp (end - (sizeof (STATE_END) - 1), STATE_END,
+                 sizeof (STATE_END) - 1) != 0
+      || strncmp (p, STATE_MAGIC, sizeof (STATE_MAGIC) - 1) != 0)
+    return -1;
+
+  parsed_count = 0;
+  p += sizeof (STATE_MAGIC) - 1;
+  *strchr (p, '\n') = '\0';
+  if (!read_number (&p, &bits) || *p != '\0' || bits != FILE_TIMESTAMP_LO_BITS)
+    return -1;
+  p += 1;
+
+  while (p < end)
+    {
+      char *nl = memchr (p, '\n', end - p);
+      char kind = *p;
+
+      /* The trailer was checked above.  */
+      if (nl + 1 == end)
+        break;
+      if (nl - p < 3 || p[1] != ' ')
+        return -1;
+      *nl = '\0';
+      p += 2;
+
+      if (kind == 'd')
+        {
+          struct state_dir rec;
+          uintmax_t mtime;
+
+          if (!read_number (&p, &rec.dev) || !read_number (&p, &rec.ino)
+              || !read_number (&p, &mtime) || !read_number (&p, &rec.ctime)
+              || *p == '\0')
+            return -1;
+
+          in_dir = 1;
+          if (!use_times)
+            {
+              p = nl + 1;
+              continue;
+            }
+
+          sd = find_state_dir (p, 1);
+          stat_state_dir (sd);
+          sd->valid = 1;
+          sd->unchanged = (sd->stat_ok && sd->dev == rec.dev
+                           && sd->ino == rec.ino && sd->mtime == mtime
+                           && sd->ctime == rec.ctime && sd->mtime < racy);
+          if (!sd->unchanged)
+            state_dirty = 1;
+        }
+      else if (kind == 'f' && in_dir)
+        {
+          uintmax_t mtime;
+
+          if (!read_number (&p, &mtime) || *p == '\0')
+            return -1;
+
+          if (sd != 0 && sd->unchanged)
+            {
+              struct state_entry *se = xmalloc (sizeof (struct state_entry));
+              se->name = strcache_add (p);
+              se->mtime = mtime;
+              hash_insert (&state_entries, se);
+              ++trusted;
+            }
+        }
+      else if (kind == 'h')
+        {
+          struct state_digest *dg;
+          uintmax_t size, mtime, digest;
+
+          if (!read_number (&p, &size) || !read_number (&p, &mtime)
+              || !read_number (&p, &digest) || *p == '\0')
+            return -1;
+
+          dg = find_digest (strcache_add (p), 1);
+          dg->size = size;
+          dg->mtime = mtime;
+          dg->digest = digest;
+          /* A file changed in the last second before the state was written
+             may have changed again since without its size or time stamp
+             showing it.  */
+          dg->known = mtime < racy;
+        }
+      else if (kind == 't')
+        {
+          struct state_target *st;
+          uintmax_t mtime, digest;
+
+          if (!read_number (&p, &mtime) || !read_number (&p, &digest)
+              || *p == '\0')
+            return -1;
+
+          st = xmalloc (sizeof (struct state_target));
+          st->name = strcache_add (p);
+          st->mtime = mtime;
+          st->digest = digest;
+          hash_insert (&state_targets, st);
+        }
+      else if (kind == 'r')
+        {
+          struct state_restat *rs;
+          uintmax_t disk, mtime, inputs;
+
+          if (!read_number (&p, &disk) || !read_number (&p, &mtime)
+              || !read_number (&p, &inputs) || *p == '\0')
+            return -1;
+
+          rs = find_restat (strcache_add (p), 1);
+          rs->disk = disk;
+          rs->mtime = mtime;
+          rs->inputs = inputs;
+          rs->valid = 1;
+        }
+      else if (kind == 'c')
+        {
+          struct state_recipe *rc;
+          uintmax_t digest;
+
+          if (!read_number (&p, &digest) || *p == '\0')
+            return -1;
+
+          rc = find_recipe (strcache_add (p), 1);
+          rc->digest = digest;
+          rc->valid = 1;
+        }
+      else if (kind == 'i')
+        {
+          uintmax_t key;
+
+          if (!read_number (&p, &key) || *p != '\0')
+            return -1;
+
+          searches_key = key;
+          searches_keyed = 1;
+        }
+      else if (kind == 'p')
+        {
+          struct state_dir rec;
+          struct state_dir *sdir;
+          uintmax_t mtime;
+
+          if (!read_number (&p, &rec.dev) || !read_number (&p, &rec.ino)
+              || !read_number (&p, &mtime) || !read_number (&p, &rec.ctime)
+              || *p == '\0')
+            return -1;
+
+          /* A directory that did not exist is recorded with inode 0.  */
+          sdir = find_search_dir (p, 1);
+          stat_state_dir (sdir);
+          sdir->valid = 1;
+          if (rec.ino == 0)
+            sdir->unchanged = !sdir->stat_ok;
+          else
+            sdir->unchanged = (sdir->stat_ok && sdir->dev == rec.dev
+                               && sdir->ino == rec.ino && sdir->mtime == mtime
+                               && sdir->ctime == rec.ctime
+                               && sdir->mtime < racy);
+
+          if (parsed_count == parsed_size)
+            {
+              parsed_size = parsed_size ? parsed_size * 2 : 64;
+              parsed_dirs = xrealloc (parsed_dirs, parsed_size
+                                      * sizeof (struct state_dir *));
+            }
+          parsed_dirs[parsed_count++] = sdir;
+        }
+      else if (kind == 's')
+        {
+          struct state_search *ss;
+          uintmax_t found, ndirs, n;
+          struct state_dir **dirs;
+          int unchanged = 1;
+          unsigned int i;
+
+          if (!read_number (&p, &found) || !read_number (&p, &ndirs)
+              || ndirs > parsed_count)
+            return -1;
+
+          dirs = alloca (ndirs * sizeof (struct state_dir *) + 1);
+          for (i = 0; i < ndirs; ++i)
+            {
+              if (!read_number (&p, &n) || n >= parsed_count)
+                return -1;
+              dirs[i] = parsed_dirs[n];
+              unchanged &= dirs[i]->unchanged;
+            }
+          if (*p == '\0')
+            return -1;
+
+          /* A search that looked in a directory that has changed may come
+             out differently now.  */
+          if (!unchanged)
+            {
+              state_dirty = 1;
+              p = nl + 1;
+              continue;
+            }
+
+          ss = find_search (strcache_add (p), 1);
+          free (ss->dirs);
+          ss->found = found;
+          ss->ndirs = ndirs;
+          ss->dirs = xmalloc (ndirs * sizeof (struct state_dir *) + 1);
+          memcpy (ss->dirs, dirs, ndirs * sizeof (struct state_dir *));
+        }
+      else
+        return -1;
+
+      p = nl + 1;
+    }
+
+  return trusted;
+}
+
+/* Set up empty tables for the entries, digests and records.  */
+
+static void
+init_state_entries (void)
+{
+  hash_init (&state_entries, 8191, state_entry_hash_1, state_entry_hash_2,
+             state_entry_hash_cmp);
+  hash_init (&state_digests, 8191, state_entry_hash_1, state_entry_hash_2,
+             state_entry_hash_cmp);
+  hash_init (&state_targets, 8191, state_entry_hash_1, state_entry_hash_2,
+             state_entry_hash_cmp);
+  hash_init (&state_restats, 251, state_entry_hash_1, state_entry_hash_2,
+             state_entry_hash_cmp);
+  hash_init (&state_recipes, 8191, state_entry_hash_1, state_entry_hash_2,
+             state_entry_hash_cmp);
+  hash_init (&state_searches, 8191, state_entry_hash_1, state_entry_hash_2,
+             state_entry_hash_cmp);
+  searches_keyed = 0;
+}
+
+/* Read the state file, if the makefiles named one, and find out which of
+   the recorded times can be used.  */
+
+void
+load_state (void)
+{
+  struct stat st;
+  char *buf;
+  FILE *fp;
+  int trusted = -1;
+  int use_times;
+
+  if (state_file_name == 0 || state_loaded)
+    return;
+
+  state_loaded = 1;
+  hash_init (&state_dirs, 1021, state_dir_hash_1, state_dir_hash_2,
+             state_dir_hash_cmp);
+  hash_init (&search_dirs, 61, state_dir_hash_1, state_dir_hash_2,
+             state_dir_hash_cmp);
+  init_state_entries ();
+
+  /* With -L, symlinks have to be looked at as well.  If commands have
+     been run already (to remake the makefiles), the times are stale.  */
+  use_times = state_times && !check_symlink_flag && !state_invalidated;
+  if (!use_times)
+    {
+      state_dirty = 1;
+      if (!state_hashes && !state_restat && !state_commands && !state_rules)
+        return;
+    }
+
+  ENULLLOOP (fp, fopen (state_file_name, "r"));
+  if (fp == 0)
+    {
+      state_dirty = 1;
+      return;
+    }
+
+  if (fstat (fileno (fp), &st) == 0 && st.st_size > 0)
+    {
+      buf = xmalloc (st.st_size + 1);
+      if (fread (buf, 1, st.st_size, fp) == (size_t) st.st_size)
+        {
+          buf[st.st_size] = '\0';
+          trusted = parse_state (buf, st.st_size,
+                                 FILE_TIMESTAMP_STAT_MODTIME (state_file_name,
+                                                              st),
+                                 use_times);
+        }
+      free (buf);
+    }
+  fclose (fp);
+
+  if (trusted < 0)
+    {
+      /* Don't use any of it.  */
+      hash_map (&state_dirs, invalidate_state_dir);
+      hash_map (&search_dirs, invalidate_state_dir);
+      hash_free (&state_entries, 1);
+      hash_free (&state_digests, 1);
+      hash_free (&state_targets, 1);
+      hash_free (&state_restats, 1);
+      hash_free (&state_recipes, 1);
+      hash_map (&state_searches, free_search);
+      hash_free (&state_searches, 0);
+      init_state_entries ();
+      state_dirty = 1;
+      trusted = 0;
+    }
+
+  if (use_times && !full_check_flag)
+    DB (DB_VERBOSE, (_("Using %d recorded file timestamps from '%s'.\n"),
+                     trusted, state_file_name));
+  if (state_hashes)
+    DB (DB_VERBOSE, (_("Using %lu recorded digests from '%s'.\n"),
+                     state_targets.ht_fill, state_file_name));
+}
+
+/* If the modification time of FILE can be taken from the state file,
+   store it in *MTIME and return nonzero.  */
+
+int
+state_mtime (struct file *file, FILE_TIMESTAMP *mtime)
+{
+  struct state_entry key;
+  struct state_entry *se;
+
+  if (state_file_name == 0 || state_invalidated || full_check_flag
+      || state_entries.ht_fill == 0 || !recordable_file (file))
+    return 0;
+
+  key.name = file->name;
+  se = hash_find_item (&state_entries, &key);
+  if (se == 0)
+    return 0;
+
+  *mtime = se->mtime;
+  return 1;
+}
+
+/* Return nonzero if FILE, which is about to be remade because some of its
+   prerequisites are newer, is up to date after all: it has not changed
+   since its record was made and those prerequisites have the same contents
+   as they had then.  */
+
+int
+hash_unchanged (struct file *file)
+{
+  struct state_target key;
+  struct state_target *st;
+  uint64_t digest;
+
+  if (!state_hashes || !state_loaded || !recordable_file (file)
+      || file->last_mtime < ORDINARY_MTIME_MIN
+      || file->last_mtime > ORDINARY_MTIME_MAX)
+    return 0;
+
+  key.name = file->name;
+  st = hash_find_item (&state_targets, &key);
+  if (st == 0 || st->mtime != file->last_mtime)
+    return 0;
+
+  /* When one target needs this, many more are likely to (after switching
+     branches, say), so check all the recorded digests at once.  */
+  if (!digests_verified)
+    {
+      struct state_digest **dgs;
+      unsigned int i, n = 0;
+
+      digests_verified = 1;
+      dgs = (struct state_digest **) hash_dump (&state_digests, 0, 0);
+      for (i = 0; dgs[i] != 0; ++i)
+        if (!dgs[i]->checked)
+          dgs[n++] = dgs[i];
+      check_digests (dgs, n);
+      free (dgs);
+    }
+
+  return deps_digest (file, file->last_mtime, &digest)
+         && digest == st->digest;
+}
+
+/* If FILE is a .RESTAT target that is taken as unchanged while it has
+   modification time MTIME, return the time it is taken to have instead.
+   Otherwise return MTIME.  */
+
+FILE_TIMESTAMP
+restat_mtime (struct file *file, FILE_TIMESTAMP mtime)
+{
+  struct state_restat *rs;
+
+  if (!state_restat || !state_loaded || !restat_checked (file))
+    return mtime;
+
+  rs = find_restat (file->name, 0);
+  if (rs == 0 || !rs->valid)
+    return mtime;
+
+  rs->active = rs->disk == mtime;
+  return rs->active ? rs->mtime : mtime;
+}
+
+/* Return nonzero if FILE, which is about to be remade because some of its
+   prerequisites are newer, is a .RESTAT target whose recipe has run since
+   they were last changed.  */
+
+int
+restat_unchanged (struct file *file)
+{
+  struct state_restat *rs;
+  FILE_TIMESTAMP newest;
+
+  if (!state_restat || !state_loaded || !restat_checked (file))
+    return 0;
+
+  rs = find_restat (file->name, 0);
+  if (rs == 0 || !rs->valid || !rs->active || file->last_mtime != rs->mtime)
+    return 0;
+
+  return newest_prereq (file, &newest) && newest <= rs->inputs;
+}
+
+/* The recipe of FILE is about to be run.  If FILE is a .RESTAT target,
+   note what it is like now.  */
+
+void
+start_restat (struct file *file)
+{
+  struct state_restat *rs;
+  struct state_digest *dg;
+  FILE_TIMESTAMP mtime = file->last_mtime;
+
+  if (!state_restat || !state_loaded || !restat_checked (file)
+      || just_print_flag || question_flag || touch_flag)
+    return;
+
+  /* A file that does not exist yet can't be left unchanged.  */
+  if (mtime < ORDINARY_MTIME_MIN || mtime > ORDINARY_MTIME_MAX)
+    {
+      rs = find_restat (file->name, 0);
+      if (rs != 0)
+        rs->valid = rs->active = 0;
+      return;
+    }
+
+  rs = find_restat (file->name, 1);
+  rs->old_mtime = mtime;
+  rs->old_disk = rs->valid && rs->active ? rs->disk : mtime;
+  dg = current_digest (file);
+  rs->have_digest = dg != 0;
+  if (dg != 0)
+    rs->old_digest = dg->digest;
+  rs->running = 1;
+}
+
+/* The recipe of FILE has finished.  If FILE is a .RESTAT target that the
+   recipe left unchanged, give it back the time it had before.  */
+
+void
+finish_restat (struct file *file)
+{
+  struct state_restat *rs;
+  FILE_TIMESTAMP newest;
+  FILE_TIMESTAMP mtime;
+  struct stat st;
+  int unchanged;
+  int e;
+
+  if (!state_restat || !state_loaded)
+    return;
+
+  rs = find_restat (file->name, 0);
+  if (rs == 0 || !rs->running)
+    return;
+  rs->running = 0;
+
+  EINTRLOOP (e, dir_stat (file->name, &st));
+  if (file->update_status != us_success || e != 0)
+    {
+      rs->valid = rs->active = 0;
+      state_dirty = 1;
+      return;
+    }
+
+  mtime = FILE_TIMESTAMP_STAT_MODTIME (file->name, st);
+  unchanged = mtime == rs->old_disk;
+  if (!unchanged && rs->have_digest)
+    {
+      struct state_digest *dg = find_digest (file->name, 1);
+
+      check_digests (&dg, 1);
+      unchanged = dg->known && dg->digest == rs->old_digest;
+    }
+
+  if (!unchanged || !newest_prereq (file, &newest))
+    {
+      rs->valid = rs->active = 0;
+      state_dirty = 1;
+      return;
+    }
+
+  rs->disk = mtime;
+  rs->mtime = rs->old_mtime;
+  rs->inputs = newest;
+  rs->valid = rs->active = 1;
+  state_dirty = 1;
+
+  file->last_mtime = rs->mtime;
+  DB (DB_BASIC, (_("Recipe left '%s' unchanged; it keeps its old time.\n"),
+                 file->name));
+}
+
+/* Return the digest of the recipe of FILE, as expanded for FILE.  This
+   sets the automatic variables of FILE.  No function with side effects is
+   run; if the recipe calls one, the digest is of the recipe as written.  */
+
+static uint64_t
+recipe_digest (struct file *file)
+{
+  struct variable *v;
+  struct digest ds;
+  char **lines;
+  unsigned int i;
+
+  chop_commands (file->cmds);
+  initialize_file_variables (file, 0);
+  set_file_variables (file, file->stem);
+
+  /* $? names the prerequisites that are newer than the target, which is
+     none of them when the target is up to date.  Take it to name all of
+     them, so that it expands alike whether or not the target is remade.  */
+  v = lookup_variable_in_set ("^", 1, file->variables->set);
+  if (v != 0)
+    define_variable_in_set ("?", 1, v->value, o_automatic, 0,
+                            file->variables->set, NILF);
+
+  no_side_effects = 1;
+  side_effects_skipped = 0;
+  lines = expand_command_lines (file);
+  no_side_effects = 0;
+
+  digest_init (&ds);
+  for (i = 0; i < file->cmds->ncommand_lines; ++i)
+    {
+      /* Whether a line is echoed or its errors ignored does not change
+         what it makes.  */
+      const char *p = side_effects_skipped
+                      ? file->cmds->command_lines[i] : lines[i];
+      while (ISSPACE (*p) || *p == '@' || *p == '-' || *p == '+')
+        ++p;
+      digest_update (&ds, p, strlen (p) + 1);
+      free (lines[i]);
+    }
+  free (lines);
+
+  return digest_final (&ds);
+}
+
+/* Return nonzero if FILE, which has a recipe, is a .CMDCHECK target whose
+   recipe has changed since it last made FILE.  */
+
+int
+recipe_changed (struct file *file)
+{
+  struct state_recipe *rc;
+  FILE_TIMESTAMP mtime = file->last_mtime;
+
+  if (!state_commands || !state_loaded || !cmd_checked (file))
+    return 0;
+
+  rc = find_recipe (file->name, 1);
+  rc->current = recipe_digest (file);
+  rc->have_current = 1;
+
+  if (rc->valid)
+    return rc->digest != rc->current;
+
+  /* A target made before its recipe was recorded is taken to have been
+     made by the recipe it has now.  */
+  if (mtime >= ORDINARY_MTIME_MIN && mtime <= ORDINARY_MTIME_MAX
+      && !just_print_flag && !question_flag)
+    {
+      rc->digest = rc->current;
+      rc->valid = 1;
+      state_dirty = 1;
+    }
+  return 0;
+}
+
+/* The recipe of FILE has finished, or FILE was touched.  If FILE is a
+   .CMDCHECK target that is now up to date, record the recipe that made
+   it.  */
+
+void
+finish_recipe (struct file *file)
+{
+  struct state_recipe *rc;
+
+  if (!state_commands || !state_loaded || just_print_flag || question_flag
+      || file->update_status != us_success)
+    return;
+
+  rc = find_recipe (file->name, 0);
+  if (rc == 0 || !rc->have_current)
+    return;
+
+  if (!rc->valid || rc->digest != rc->current)
+    {
+      rc->digest = rc->current;
+      rc->valid = 1;
+      state_dirty = 1;
+    }
+}
+
+/* Work out the key of the implicit rule searches made in this run: a digest
+   of the pattern rules, in order, and of the names of the files that make
+   knows of.  The searches recorded with another key are dropped.  */
+
+static uint64_t names_sum;
+
+static void
+sum_file_name (const void *item)
+{
+  const struct file *f = item;
+  struct digest ds;
+
+  /* The names are summed, since their order in the table means nothing.  */
+  digest_init (&ds);
+  digest_update (&ds, f->name, strlen (f->name));
+  names_sum += digest_final (&ds);
+}
+
+static void
+digest_rules (void)
+{
+  struct digest ds;
+  struct rule *rule;
+  uint64_t key;
+
+  rules_digested = 1;
+
+  /* Which files a search path or a secondary expansion leads to depends on
+     more than the directories the search looks in.  */
+  if (vpath_defined_p () || second_expansion)
+    {
+      searches_stopped = 1;
+      return;
+    }
+
+  digest_init (&ds);
+  for (rule = pattern_rules; rule != 0; rule = rule->next)
+    {
+      struct dep *d;
+      unsigned int i;
+      char flags[3];
+
+      flags[0] = rule->terminal;
+      flags[1] = rule->cmds != 0;
+      digest_update (&ds, flags, 2);
+      digest_update (&ds, &rule->num, sizeof (rule->num));
+      for (i = 0; i < rule->num; ++i)
+        digest_update (&ds, rule->targets[i], strlen (rule->targets[i]) + 1);
+      for (d = rule->deps; d != 0; d = d->next)
+        {
+          const char *name = dep_name (d);
+          flags[0] = d->ignore_mtime;
+          flags[1] = d->ignore_automatic_vars;
+          flags[2] = d->wait_here;
+          digest_update (&ds, flags, 3);
+          digest_update (&ds, name, strlen (name) + 1);
+        }
+      digest_update (&ds, "", 1);
+    }
+
+  names_sum = 0;
+  map_files (sum_file_name);
+  digest_update (&ds, &names_sum, sizeof (names_sum));
+  key = digest_final (&ds);
+
+  if (searches_keyed && searches_key != key && state_searches.ht_fill > 0)
+    {
+      hash_map (&state_searches, free_search);
+      hash_free (&state_searches, 0);
+      hash_init (&state_searches, 8191, state_entry_hash_1,
+                 state_entry_hash_2, state_entry_hash_cmp);
+    }
+  if (!searches_keyed || searches_key != key)
+    state_dirty = 1;
+  searches_key = key;
+  searches_keyed = 1;
+}
+
+/* Return nonzero if implicit rule searches can be recorded and replayed
+   now.  */
+
+static int
+searches_usable (void)
+{
+  if (!state_rules || !state_loaded || state_invalidated || searches_stopped)
+    return 0;
+  if (!rules_digested)
+    digest_rules ();
+  return !searches_stopped;
+}
+
+/* If the implicit rule search for FILE is recorded and would come out the
+   same now, store what it found in *FOUND and return nonzero: the number
+   of the pattern rule target, plus one, or zero if no rule applies.  */
+
+int
+replay_rule_search (struct file *file, unsigned int *found)
+{
+  struct state_search *ss;
+  unsigned int i;
+
+  if (full_check_flag || !searches_usable () || !rule_cached (file))
+    return 0;
+
+  ss = find_search (file->name, 0);
+  if (ss == 0)
+    return 0;
+
+  for (i = 0; i < ss->ndirs; ++i)
+    if (!ss->dirs[i]->unchanged)
+      return 0;
+
+  *found = ss->found;
+  return 1;
+}
+
+/* The implicit rule search for FILE is about to be made.  Record it, if
+   FILE is a .RULECACHE target.  */
+
+void
+start_rule_search (struct file *file)
+{
+  search_file = 0;
+  if (searches_usable () && rule_cached (file))
+    {
+      search_file = file;
+      search_count = 0;
+    }
+}
+
+/* The implicit rule search being made looks for a prerequisite NAME.  Note
+   the directory it looks in.  */
+
+void
+note_rule_probe (const char *name)
+{
+  static struct state_dir *probe_dir;
+  static size_t probe_len;
+  struct state_dir *sd;
+  const char *slash;
+  size_t len;
+  unsigned int i;
+
+  if (search_file == 0)
+    return;
+
+  if (strchr (name, '\n') != 0)
+    {
+      search_file = 0;
+      return;
+    }
+
+  /* Searches look in the same directory many times over.  */
+  slash = strrchr (name, '/');
+  len = slash == 0 ? 0 : slash == name ? 1 : slash - name;
+  if (probe_dir != 0 && len == probe_len
+      && memcmp (name, probe_dir->name, len) == 0)
+    sd = probe_dir;
+  else
+    {
+      sd = find_search_dir (state_dir_name (name), 1);
+      probe_dir = sd;
+      probe_len = len;
+    }
+  if (!sd->valid)
+    {
+      stat_state_dir (sd);
+      sd->valid = 1;
+    }
+
+  for (i = 0; i < search_count; ++i)
+    if (search_list[i] == sd)
+      return;
+
+  if (search_count == search_size)
+    {
+      search_size = search_size ? search_size * 2 : 16;
+      search_list = xrealloc (search_list,
+                              search_size * sizeof (struct state_dir *));
+    }
+  search_list[search_count++] = sd;
+}
+
+/* The implicit rule search for FILE has found the pattern rule target
+   numbered FOUND, less one, or no rule if FOUND is zero.  Record that, if
+   the search is being recorded.  */
+
+void
+finish_rule_search (struct file *file, unsigned int found)
+{
+  struct state_search *ss;
+
+  if (search_file != file || file == 0)
+    return;
+  search_file = 0;
+
+  ss = find_search (file->name, 1);
+  if (ss->found == found && ss->ndirs == search_count && ss->dirs != 0
+      && memcmp (ss->dirs, search_list,
+                 search_count * sizeof (struct state_dir *)) == 0)
+    return;
+
+  free (ss->dirs);
+  ss->found = found;
+  ss->ndirs = search_count;
+  ss->dirs = xmalloc (search_count * sizeof (struct state_dir *) + 1);
+  memcpy (ss->dirs, search_list, search_count * sizeof (struct state_dir *));
+  state_dirty = 1;
+}
+
+/* An implicit rule search has entered a file that need not exist.  Later
+   searches may find it, where a search made without it did not, so none
+   is recorded or replayed from now on.  */
+
+void
+stop_rule_searches (void)
+{
+  searches_stopped = 1;
+  search_file = 0;
+}
+
+/* Saving the state: the targets to record, and their directories.  */
+
+struct state_record
+  {
+    struct file *file;
+    struct state_dir *dir;
+    FILE_TIMESTAMP mtime;
+  };
+
+static struct state_record *records;
+static unsigned int record_count;
+static unsigned int record_size;
+
+static void
+collect_record (const void *item)
+{
+  struct file *f = (struct file *) item;
+  struct state_record *r;
+  struct state_dir *sd;
+
+  if (!recordable_file (f) || f->update_status == us_failed)
+    return;
+
+  /* The time of a .RESTAT target that is taken as unchanged is not the one
+     it has.  */
+  if (state_restat && restat_checked (f))
+    {
+      struct state_restat *rs = find_restat (f->name, 0);
+      if (rs != 0 && rs->active)
+        return;
+    }
+
+  /* Directories that were not verified when the state was loaded, or that
+     commands may have changed, are looked at again now, before any of the
+     files in them.  */
+  sd = find_state_dir (state_dir_name (f->name), 1);
+  if (!sd->valid)
+    {
+      stat_state_dir (sd);
+      sd->valid = 1;
+      state_dirty = 1;
+    }
+  if (!sd->stat_ok)
+    return;
+
+  if (record_count == record_size)
+    {
+      record_size = record_size ? record_size * 2 : 1024;
+      records = xrealloc (records, record_size * sizeof (struct state_record));
+    }
+  r = &records[record_count++];
+  r->file = f;
+  r->dir = sd;
+}
+
+static int
+record_cmp (const void *x, const void *y)
+{
+  const struct state_record *a = x;
+  const struct state_record *b = y;
+  int r = strcmp (a->dir->name, b->dir->name);
+  return r ? r : strcmp (a->file->name, b->file->name);
+}
+
+/* Bringing the target records up to date: the targets whose records have
+   to be made again, and the digests that are needed for them.  */
+
+static struct file **hashed_targets;
+static unsigned int hashed_count;
+static unsigned int hashed_size;
+
+static struct state_digest **needed_digests;
+static unsigned int needed_count;
+static unsigned int needed_size;
+
+static void
+collect_hashed_target (const void *item)
+{
+  struct file *f = (struct file *) item;
+  struct state_target key;
+  struct state_target *st;
+  struct dep amake;
+  struct dep *ad;
+
+  if (!recordable_file (f) || !f->updated || f->update_status != us_success)
+    return;
+
+  /* A record that still matches the target stays true.  */
+  key.name = f->name;
+  st = hash_find_item (&state_targets, &key);
+  if (st != 0 && st->mtime == f->last_mtime)
+    return;
+
+  if (hashed_count == hashed_size)
+    {
+      hashed_size = hashed_size ? hashed_size * 2 : 1024;
+      hashed_targets = xrealloc (hashed_targets,
+                                 hashed_size * sizeof (struct file *));
+    }
+  hashed_targets[hashed_count++] = f;
+
+  amake.file = f;
+  amake.next = f->also_make;
+  for (ad = &amake; ad != 0; ad = ad->next)
+    {
+      struct dep *d;
+
+      for (d = ad->file->deps; d != 0; d = d->next)
+        {
+          struct file *df = d->file;
+          struct state_digest *dg;
+
+          check_renamed (df);
+          if (d->ignore_mtime || !hash_checked (df))
+            continue;
+
+          dg = find_digest (df->name, 1);
+          if (dg->checked || dg->queued)
+            continue;
+
+          if (needed_count == needed_size)
+            {
+              needed_size = needed_size ? needed_size * 2 : 1024;
+              needed_digests = xrealloc (needed_digests,
+                                         needed_size
+                                         * sizeof (struct state_digest *));
+            }
+          needed_digests[needed_count++] = dg;
+          dg->queued = 1;
+        }
+    }
+}
+
+static void
+uncheck_digest (const void *item)
+{
+  struct state_digest *dg = (struct state_digest *) item;
+  dg->checked = 0;
+}
+
+/* Record the digests of the prerequisites of the targets that were brought
+   up to date, unless their records are still good.  */
+
+static void
+update_target_records (void)
+{
+  unsigned int i;
+
+  /* Under -n and -q, targets that seem to have been remade were not.  */
+  if (just_print_flag || question_flag)
+    return;
+
+  /* Commands may have changed any file since its digest was checked.  */
+  if (state_invalidated)
+    hash_map (&state_digests, uncheck_digest);
+  digests_final = 1;
+
+  hashed_count = needed_count = 0;
+  map_files (collect_hashed_target);
+  if (needed_count > 0)
+    check_digests (needed_digests, needed_count);
+
+  for (i = 0; i < hashed_count; ++i)
+    {
+      struct file *f = hashed_targets[i];
+      FILE_TIMESTAMP mtime = f->last_mtime;
+      struct state_target key;
+      struct state_target *st;
+      uint64_t digest;
+      int ok;
+
+      if (mtime < ORDINARY_MTIME_MIN || mtime > ORDINARY_MTIME_MAX)
+        {
+          struct stat sb;
+          int e;
+
+          EINTRLOOP (e, dir_stat (f->name, &sb));
+          mtime = e == 0 ? FILE_TIMESTAMP_STAT_MODTIME (f->name, sb)
+                         : NONEXISTENT_MTIME;
+        }
+      ok = mtime != NONEXISTENT_MTIME && deps_digest (f, mtime, &digest);
+
+      key.name = f->name;
+      st = hash_find_item (&state_targets, &key);
+      if (!ok)
+        {
+          if (st != 0)
+            {
+              hash_delete (&state_targets, st);
+              free (st);
+              state_dirty = 1;
+            }
+          continue;
+        }
+
+      if (st == 0)
+        {
+          st = xmalloc (sizeof (struct state_target));
+          st->name = f->name;
+          hash_insert (&state_targets, st);
+        }
+      else if (st->mtime == mtime && st->digest == digest)
+        continue;
+
+      st->mtime = mtime;
+      st->digest = digest;
+      state_dirty = 1;
+    }
+}
+
+static int
+name_cmp (const void *x, const void *y)
+{
+  return strcmp (**(const char ***) x, **(const char ***) y);
+}
+
+static void
+unnumber_dir (const void *item)
+{
+  struct state_dir *sd = (struct state_dir *) item;
+  sd->num = 0;
+}
+
+/* Write out the key of the implicit rule searches, the directories they
+   looked in, numbered from 0 in the order they are written, and the
+   searches.  */
+
+static void
+write_searches (FILE *fp)
+{
+  struct state_search **sss;
+  unsigned int count = 0;
+  unsigned int i, j;
+
+  fputs ("i ", fp);
+  write_number (fp, searches_key);
+  putc ('\n', fp);
+
+  hash_map (&search_dirs, unnumber_dir);
+  sss = (struct state_search **) hash_dump (&state_searches, 0, name_cmp);
+  for (i = 0; sss[i] != 0; ++i)
+    if (lookup_file (sss[i]->name) != 0)
+      for (j = 0; j < sss[i]->ndirs; ++j)
+        {
+          struct state_dir *sd = sss[i]->dirs[j];
+          if (sd->num != 0)
+            continue;
+
+          sd->num = ++count;
+          fputs ("p ", fp);
+          if (sd->stat_ok)
+            {
+              write_number (fp, sd->dev);
+              putc (' ', fp);
+              write_number (fp, sd->ino);
+              putc (' ', fp);
+              write_number (fp, sd->mtime);
+              putc (' ', fp);
+              write_number (fp, sd->ctime);
+            }
+          else
+            fputs ("0 0 0 0", fp);
+          fprintf (fp, " %s\n", sd->name);
+        }
+
+  for (i = 0; sss[i] != 0; ++i)
+    if (lookup_file (sss[i]->name) != 0)
+      {
+        fputs ("s ", fp);
+        write_number (fp, sss[i]->found);
+        putc (' ', fp);
+        write_number (fp, sss[i]->ndirs);
+        for (j = 0; j < sss[i]->ndirs; ++j)
+          {
+            putc (' ', fp);
+            write_number (fp, sss[i]->dirs[j]->num - 1);
+          }
+        fprintf (fp, " %s\n", sss[i]->name);
+      }
+  free (sss);
+}
+
+/* Write out the first USED records, which are sorted, and the digests of
+   files that make still knows about.  The file is rewritten in place, so
+   that its directory does not change.  */
+
+static void
+write_state (unsigned int used)
+{
+  unsigned int i;
+  struct state_dir *sd = 0;
+  FILE *fp;
+  int fd;
+
+  EINTRLOOP (fd, open (state_file_name, O_WRONLY | O_TRUNC));
+  if (fd < 0 || (fp = fdopen (fd, "w")) == 0)
+    {
+      perror_with_name (_("cannot write state file: "), state_file_name);
+      if (fd >= 0)
+        close (fd);
+      return;
+    }
+
+  fputs (STATE_MAGIC, fp);
+  write_number (fp, FILE_TIMESTAMP_LO_BITS);
+  putc ('\n', fp);
+  for (i = 0; i < used; ++i)
+    {
+      struct state_record *r = &records[i];
+
+      if (r->dir != sd)
+        {
+          sd = r->dir;
+          fputs ("d ", fp);
+          write_number (fp, sd->dev);
+          putc (' ', fp);
+          write_number (fp, sd->ino);
+          putc (' ', fp);
+          write_number (fp, sd->mtime);
+          putc (' ', fp);
+          write_number (fp, sd->ctime);
+          fprintf (fp, " %s\n", sd->name);
+        }
+
+      fputs ("f ", fp);
+      write_number (fp, r->mtime);
+      fprintf (fp, " %s\n", r->file->name);
+    }
+
+  if (state_hashes || state_restat || state_commands)
+    {
+      struct state_digest **dgs;
+      struct state_target **sts;
+      struct state_restat **rss;
+      struct state_recipe **rcs;
+
+      dgs = (struct state_digest **) hash_dump (&state_digests, 0, name_cmp);
+      for (i = 0; dgs[i] != 0; ++i)
+        if (dgs[i]->known && lookup_file (dgs[i]->name) != 0)
+          {
+            fputs ("h ", fp);
+            write_number (fp, dgs[i]->size);
+            putc (' ', fp);
+            write_number (fp, dgs[i]->mtime);
+            putc (' ', fp);
+            write_number (fp, dgs[i]->digest);
+            fprintf (fp, " %s\n", dgs[i]->name);
+          }
+      free (dgs);
+
+      sts = (struct state_target **) hash_dump (&state_targets, 0, name_cmp);
+      for (i = 0; sts[i] != 0; ++i)
+        if (lookup_file (sts[i]->name) != 0)
+          {
+            fputs ("t ", fp);
+            write_number (fp, sts[i]->mtime);
+            putc (' ', fp);
+            write_number (fp, sts[i]->digest);
+            fprintf (fp, " %s\n", sts[i]->name);
+          }
+      free (sts);
+
+      rss = (struct state_restat **) hash_dump (&state_restats, 0, name_cmp);
+      for (i = 0; rss[i] != 0; ++i)
+        if (rss[i]->valid && lookup_file (rss[i]->name) != 0)
+          {
+            fputs ("r ", fp);
+            write_number (fp, rss[i]->disk);
+            putc (' ', fp);
+            write_number (fp, rss[i]->mtime);
+            putc (' ', fp);
+            write_number (fp, rss[i]->inputs);
+            fprintf (fp, " %s\n", rss[i]->name);
+          }
+      free (rss);
+
+      rcs = (struct state_recipe **) hash_dump (&state_recipes, 0, name_cmp);
+      for (i = 0; rcs[i] != 0; ++i)
+        if (rcs[i]->valid && lookup_file (rcs[i]->name) != 0)
+          {
+            fputs ("c ", fp);
+            write_number (fp, rcs[i]->digest);
+            fprintf (fp, " %s\n", rcs[i]->name);
+          }
+      free (rcs);
+    }
+
+  if (state_rules && searches_keyed)
+    write_searches (fp);
+  fputs (STATE_END, fp);
+
+  if (fclose (fp) != 0)
+    perror_with_name (_("cannot write state file: "), state_file_name);
+}
+
+/* Make is about to run a command, which may change any file.  Stop using
+   the recorded times, and drop them from the state file so that it isn't
+   used by a later run either, should this one not get to save it.  The
+   digests, .RESTAT, .CMDCHECK and .RULECACHE records remain true, so keep
+   those.  */
+
+void
+invalidate_state (void)
+{
+  int fd;
+
+  if (state_file_name == 0 || state_invalidated)
+    return;
+
+  state_invalidated = 1;
+  state_dirty = 1;
+
+  /* This may be while the makefiles are being remade.  */
+  if (state_hashes || state_restat || state_commands || state_rules)
+    load_state ();
+
+  /* There is nothing to drop if there is no state file yet.  */
+  EINTRLOOP (fd, open (state_file_name, O_WRONLY | O_TRUNC));
+  if (fd < 0)
+    return;
+  close (fd);
+
+  if (state_digests.ht_fill + state_restats.ht_fill
+      + state_recipes.ht_fill + state_searches.ht_fill > 0)
+    write_state (0);
+}
+
+/* Get ready to update the goals again, as a make server does for each
+   request.  Any file may have changed since its digest was checked.  */
+
+void
+reset_state (void)
+{
+  if (!state_loaded)
+    return;
+
+  hash_map (&state_digests, uncheck_digest);
+  digests_verified = digests_final = 0;
+}
+
+/* Write out the state, if the makefiles named a state file and it has
+   changed.  */
+
+void
+save_state (void)
+{
+  unsigned int used = 0;
+  unsigned int i;
+  int fd;
+
+  /* With -n or -q nothing was remade, and the state file of the real
+     build must not be rewritten or created.  */
+  if (state_file_name == 0 || just_print_flag || question_flag)
+    return;
+
+  /* Create the state file before looking at any directory, since that
+     changes the directory it is in.  */
+  EINTRLOOP (fd, open (state_file_name, O_WRONLY | O_CREAT, 0666));
+  if (fd < 0)
+    {
+      perror_with_name (_("cannot write state file: "), state_file_name);
+      return;
+    }
+  close (fd);
+
+  /* Once commands have run, any directory may have changed.  */
+  if (state_invalidated)
+    hash_map (&state_dirs, invalidate_state_dir);
+
+  record_count = 0;
+  if (state_times)
+    map_files (collect_record);
+
+  for (i = 0; i < record_count; ++i)
+    {
+      struct state_record *r = &records[i];
+      struct file *f = r->file;
+      struct state_entry key;
+      struct state_entry *se;
+
+      key.name = f->name;
+      se = hash_find_item (&state_entries, &key);
+
+      /* A file in a directory that has changed may have been replaced after
+         make looked at it, so look again now that the directory has been
+         looked at.  */
+      if (!state_invalidated && r->dir->unchanged
+          && f->last_mtime >= ORDINARY_MTIME_MIN
+          && f->last_mtime <= ORDINARY_MTIME_MAX)
+        r->mtime = f->last_mtime;
+      else if (!state_invalidated && r->dir->unchanged && se != 0
+               && f->last_mtime != NEW_MTIME)
+        r->mtime = se->mtime;
+      else
+        {
+          struct stat st;
+          int e;
+
+          EINTRLOOP (e, dir_stat (f->name, &st));
+          r->mtime = e == 0 ? FILE_TIMESTAMP_STAT_MODTIME (f->name, st)
+                            : NONEXISTENT_MTIME;
+        }
+
+      if (r->mtime == NONEXISTENT_MTIME)
+        continue;
+
+      if (se == 0 || se->mtime != r->mtime)
+        state_dirty = 1;
+      records[used++] = *r;
+    }
+
+  if (used != state_entries.ht_fill)
+    state_dirty = 1;
+
+  if (state_hashes)
+    update_target_records ();
+
+  if (!state_dirty)
+    return;
+
+  qsort (records, used, sizeof (struct state_record), record_cmp);
+  write_state (used);
+  state_dirty = 0;
+}
@@ -23,10 +23,23 @@ this program.  If not, see <https://www.gnu.org/licenses/>.  */
 
 /* A string cached here will never be freed, so we don't need to worry about
    reference counting.  We just store the string, and then remember it in a
-   hash so it can be looked up again. */
+   hash so it can be looked up again.
+
+   Each string is preceded by a small header that holds its length and its
+   hash value, so that callers holding a cached string can get at these
+   without walking the string again (see strcache_get_len() and
+   strcache_get_hash()).  The header is not aligned, so it is always accessed
+   through memcpy(). */
 
 typedef unsigned short int sc_buflen_t;
 
+struct sc_header {
+  unsigned int len;         /* Length of the string, without the nul.  */
+  unsigned int hash;        /* STRING_HASH_1 of the string.  */
+};
+
+#define SC_HEADER_SIZE          (sizeof (struct sc_header))
+
 struct strcache {
   struct strcache *next;    /* The next block of strings.  Must be first!  */
   sc_buflen_t end;          /* Offset to the beginning of free space.  */
@@ -71,14 +84,32 @@ new_cache (struct strcache **head, sc_buflen_t buflen)
   return new;
 }
 
+/* Store the header for a string of length LEN at DEST, followed by the
+   string itself.  Returns a pointer to the copied string.  */
+static char *
+store_string (char *dest, const char *str, unsigned int len)
+{
+  struct sc_header hdr;
+  char *res = dest + SC_HEADER_SIZE;
+
+  hdr.len = len;
+  hdr.hash = 0;
+  STRING_HASH_1 (str, hdr.hash);
+  memcpy (dest, &hdr, SC_HEADER_SIZE);
+
+  memmove (res, str, len);
+  res[len] = '\0';
+
+  return res;
+}
+
 static const char *
 copy_string (struct strcache *sp, const char *str, unsigned int len)
 {
-  /* Add the string to this cache.  */
-  char *res = &sp->buffer[sp->end];
+  /* Add the string (and its header) to this cache.  */
+  char *res = store_string (&sp->buffer[sp->end], str, len);
 
-  memmove (res, str, len);
-  res[len++] = '\0';
+  len += SC_HEADER_SIZE + 1;
   sp->end += (sc_buflen_t) len;
   sp->bytesfree -= (sc_buflen_t) len;
   ++sp->count;
@@ -92,8 +123,8 @@ add_string (const char *str, unsigned int len)
   const char *res;
   struct strcache *sp;
   struct strcache **spp = &strcache;
-  /* We need space for the nul char.  */
-  sc_buflen_t sz = len + 1;
+  /* We need space for the header and the nul char.  */
+  sc_buflen_t sz = len + SC_HEADER_SIZE + 1;
 
   ++total_strings;
   total_size += sz;
@@ -134,10 +165,11 @@ add_string (const char *str, unsigned int len)
   return res;
 }
 
-/* For strings too large for the strcache, we just save them in a list.  */
+/* For strings too large for the strcache, we just save them in a list.
+   These get a header too, so the accessors work on every cached string.  */
 struct hugestring {
   struct hugestring *next;  /* The next string.  */
-  char buffer[1];           /* The string.  */
+  char buffer[1];           /* The header, then the string.  */
 };
 
 static struct hugestring *hugestrings = NULL;
@@ -145,14 +177,14 @@ static struct hugestring *hugestrings = NULL;
 static const char *
 add_hugestring (const char *str, unsigned int len)
 {
-  struct hugestring *new = xmalloc (sizeof (struct hugestring) + len);
-  memcpy (new->buffer, str, len);
-  new->buffer[len] = '\0';
+  struct hugestring *new = xmalloc (sizeof (struct hugestring)
+                                    + SC_HEADER_SIZE + len);
+  const char *res = store_string (new->buffer, str, len);
 
   new->next = hugestrings;
   hugestrings = new;
 
-  return new->buffer;
+  return res;
 }
 
 /* Hash table of strings in the cache.  */
@@ -186,7 +218,7 @@ add_hash (const char *str, unsigned int len)
 
   /* If it's too large for the string cache, just copy it.
      We don't bother trying to match these.  */
-  if (len > USHRT_MAX - 1)
+  if (len > USHRT_MAX - SC_HEADER_SIZE - 1)
     return add_hugestring (str, len);
 
   /* Look up the string in the hash.  If it's there, return it.  */
@@ -221,7 +253,7 @@ strcache_iscached (const char *str)
   {
     struct hugestring *hp;
     for (hp = hugestrings; hp != 0; hp = hp->next)
-      if (str == hp->buffer)
+      if (str == hp->buffer + SC_HEADER_SIZE)
         return 1;
   }
 
@@ -253,6 +285,27 @@ strcache_add_len (const char *str, size_t len)
   return add_hash (str, len);
 }
 
+/* Return the length of STR, which must have been returned by strcache_add()
+   or strcache_add_len().  This is the same as strlen(), but without having
+   to walk the string.  */
+size_t
+strcache_get_len (const char *str)
+{
+  struct sc_header hdr;
+  memcpy (&hdr, str - SC_HEADER_SIZE, SC_HEADER_SIZE);
+  return hdr.len;
+}
+
+/* Return the STRING_HASH_1 hash value of STR, which must have been returned
+   by strcache_add() or strcache_add_len().  */
+unsigned long
+strcache_get_hash (const char *str)
+{
+  struct sc_header hdr;
+  memcpy (&hdr, str - SC_HEADER_SIZE, SC_HEADER_SIZE);
+  return hdr.hash;
+}
+
 void
 strcache_init (void)
 {
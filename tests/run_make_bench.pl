@@ -0,0 +1,162 @@
+#!/usr/bin/env perl
+# -*-perl-*-
+
+# Benchmark driver for Make+
+
+# Usage:  run_make_bench  [benchname ...]
+#                         [-make <make prog>]
+#                         [-runs <count>]
+#                         [-scale <factor>]
+#                         [-keep]
+#
+# Each benchmark is a Perl script in the "bench" directory.  It generates a
+# tree of files in work/bench/<benchname> and times one or more invocations
+# of make in it with bench_run().  The -scale option multiplies the default
+# size of every generated tree, -runs sets how often each invocation is
+# repeated (the best and the median time are reported, and the least CPU
+# time, in total and in the kernel).
+
+# This file is part of Make+.
+#
+# Make+ is free software; you can redistribute it and/or modify it under
+# the terms of the GNU General Public License as published by the Free Software
+# Foundation; either version 3 of the License, or (at your option) any later
+# version.
+#
+# Make+ is distributed in the hope that it will be useful, but WITHOUT ANY
+# WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+# details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program.  If not, see <http://www.gnu.org/licenses/>.
+
+use strict;
+use warnings;
+use Cwd;
+use File::Path qw(mkpath rmtree);
+use Time::HiRes qw(time);
+
+our $make_path = 'make';
+our $runs = 5;
+our $scale = 1.0;
+our $keep = 0;
+our $bench_name;
+
+my $cwd = getcwd ();
+my $benchdir = "$cwd/bench";
+my $workdir = "$cwd/work/bench";
+my @benches;
+
+while (@ARGV) {
+  my $arg = shift @ARGV;
+  if ($arg =~ /^-make([-_]?path)?$/) {
+    $make_path = shift @ARGV;
+    $make_path = "$cwd/$make_path" if $make_path =~ m,/, && $make_path !~ m,^/,;
+  } elsif ($arg eq '-runs') {
+    $runs = shift @ARGV;
+  } elsif ($arg eq '-scale') {
+    $scale = shift @ARGV;
+  } elsif ($arg eq '-keep') {
+    $keep = 1;
+  } elsif ($arg =~ /^-/) {
+    die "Usage: $0 [-make <prog>] [-runs <n>] [-scale <f>] [-keep] [bench ...]\n";
+  } else {
+    push @benches, $arg;
+  }
+}
+
+if (!@benches) {
+  opendir (my $dh, $benchdir) or die "$benchdir: $!\n";
+  @benches = sort grep { !/^\./ && !/~$/ && -f "$benchdir/$_" } readdir ($dh);
+  closedir ($dh);
+}
+
+# ---- Helpers for the benchmark scripts.
+
+# Scale a default count by the -scale factor (at least 1).
+sub scaled
+{
+  my ($n) = @_;
+  my $r = int ($n * $scale);
+  return $r < 1 ? 1 : $r;
+}
+
+# Create an empty work directory for the current benchmark and enter it.
+sub bench_setup
+{
+  my $dir = "$workdir/$bench_name";
+  chdir ($cwd);
+  rmtree ($dir);
+  mkpath ($dir);
+  chdir ($dir) or die "$dir: $!\n";
+}
+
+# Write CONTENT to file NAME, creating directories as needed.
+sub write_file
+{
+  my ($name, $content) = @_;
+  if ($name =~ m,^(.*)/[^/]+$,) {
+    mkpath ($1) unless -d $1;
+  }
+  open (my $fh, '>', $name) or die "$name: $!\n";
+  print $fh $content if defined $content;
+  close ($fh);
+}
+
+# Set the modification time of FILES to TIME.
+sub set_mtime
+{
+  my ($time, @files) = @_;
+  utime ($time, $time, @files);
+}
+
+# Run make with ARGS once without timing it (to set up the tree).
+sub bench_prepare
+{
+  my ($args) = @_;
+  system ("$make_path $args >/dev/null 2>&1");
+}
+
+# Time $runs invocations of make with ARGS and report them under LABEL.
+# Returns the best wall-clock time.
+sub bench_run
+{
+  my ($label, $args) = @_;
+  my (@wall, @cpu, @sys);
+
+  for (1 .. $runs) {
+    my @t0 = times ();
+    my $s = time ();
+    system ("$make_path $args >/dev/null 2>&1");
+    my $e = time ();
+    my @t1 = times ();
+    push @wall, $e - $s;
+    push @cpu, ($t1[2] + $t1[3]) - ($t0[2] + $t0[3]);
+    push @sys, $t1[3] - $t0[3];
+  }
+
+  @wall = sort { $a <=> $b } @wall;
+  @cpu = sort { $a <=> $b } @cpu;
+  @sys = sort { $a <=> $b } @sys;
+  printf("%-24s %-32s best %8.3fs  median %8.3fs  cpu %8.3fs  sys %8.3fs\n",
+         $bench_name, $label, $wall[0], $wall[$#wall / 2], $cpu[0], $sys[0]);
+  return $wall[0];
+}
+
+# ---- Run the benchmarks.
+
+printf("Make: %s  runs: %d  scale: %g\n", $make_path, $runs, $scale);
+
+foreach $bench_name (@benches) {
+  my $script = "$benchdir/$bench_name";
+  die "$script: no such benchmark\n" unless -f $script;
+  do $script;
+  die "$bench_name: $@" if $@;
+  chdir ($cwd);
+  rmtree ("$workdir/$bench_name") unless $keep;
+}
+
+rmtree ($workdir) unless $keep;
+
+1;
@@ -44,6 +44,8 @@ static struct pattern_var *pattern_vars = NULL;
 
 static struct pattern_var *last_pattern_vars[256];
 
+static void invalidate_pattern_var_index (void);
+
 /* Create a new pattern-specific variable struct. The new variable is
    inserted into the PATTERN_VARS list in the shortest patterns first
    order to support the shortest stem matching (the variables are
@@ -96,46 +98,125 @@ create_pattern_var (const char *target, const char *suffix)
   if (len < 256)
     last_pattern_vars[len] = p;
 
+  invalidate_pattern_var_index ();
+
   return p;
 }
 
-/* Look up a target in the pattern-specific variable list.  */
+/* The index of pattern-specific variables; see pattern_index_find in
+   rule.c.  The patterns are numbered in the order of PATTERN_VARS, so the
+   matches for a target come out in that order.  The index is built when it
+   is first needed, and again after a new pattern variable is defined.  */
+
+static struct pattern_index pattern_var_index;
+
+/* The patterns, by number.  */
+static struct pattern_var **pattern_var_vec;
+
+static int pattern_var_index_valid = 0;
+
+static void
+invalidate_pattern_var_index (void)
+{
+  if (!pattern_var_index_valid)
+    return;
+
+  pattern_index_free (&pattern_var_index);
+  free (pattern_var_vec);
+  pattern_var_vec = 0;
+  pattern_var_index_valid = 0;
+}
 
-static struct pattern_var *
-lookup_pattern_var (struct pattern_var *start, const char *target)
+static void
+build_pattern_var_index (void)
 {
   struct pattern_var *p;
-  unsigned int targlen = strlen (target);
+  unsigned int n = 0;
+
+  for (p = pattern_vars; p != 0; p = p->next)
+    ++n;
+
+  pattern_index_init (&pattern_var_index, n);
+  pattern_var_vec = xmalloc ((n + 1) * sizeof (struct pattern_var *));
 
-  for (p = start ? start->next : pattern_vars; p != 0; p = p->next)
+  n = 0;
+  for (p = pattern_vars; p != 0; p = p->next, ++n)
     {
-      const char *stem;
-      size_t stemlen;
-
-      if (p->len > targlen)
-        /* It can't possibly match.  */
-        continue;
-
-      /* From the lengths of the filename and the pattern parts,
-         find the stem: the part of the filename that matches the %.  */
-      stem = target + (p->suffix - p->target - 1);
-      stemlen = targlen - p->len + 1;
-
-      /* Compare the text in the pattern before the stem, if any.  */
-      if (stem > target && !strneq (p->target, target, stem - target))
-        continue;
-
-      /* Compare the text in the pattern after the stem, if any.
-         We could test simply using streq, but this way we compare the
-         first two characters immediately.  This saves time in the very
-         common case where the first character matches because it is a
-         period.  */
-      if (*p->suffix == stem[stemlen]
-          && (*p->suffix == '\0' || streq (&p->suffix[1], &stem[stemlen+1])))
-        break;
+      pattern_var_vec[n] = p;
+      pattern_index_add (&pattern_var_index, p->target, p->suffix, p->len, n);
     }
 
-  return p;
+  pattern_var_index_valid = 1;
+}
+
+/* Return nonzero if the pattern of P matches TARGET, TARGLEN bytes long.  */
+
+static int
+pattern_var_matches (const struct pattern_var *p, const char *target,
+                     size_t targlen)
+{
+  const char *stem;
+  size_t stemlen;
+
+  if (p->len > targlen)
+    /* It can't possibly match.  */
+    return 0;
+
+  /* From the lengths of the filename and the pattern parts,
+     find the stem: the part of the filename that matches the %.  */
+  stem = target + (p->suffix - p->target - 1);
+  stemlen = targlen - p->len + 1;
+
+  /* Compare the text in the pattern before the stem, if any.  */
+  if (stem > target && !strneq (p->target, target, stem - target))
+    return 0;
+
+  /* Compare the text in the pattern after the stem, if any.
+     We could test simply using streq, but this way we compare the
+     first two characters immediately.  This saves time in the very
+     common case where the first character matches because it is a
+     period.  */
+  return (*p->suffix == stem[stemlen]
+          && (*p->suffix == '\0' || streq (&p->suffix[1], &stem[stemlen+1])));
+}
+
+/* Find the pattern-specific variables whose patterns match TARGET, and put
+   them in a new array in *VARS, in the order of PATTERN_VARS.  Return how
+   many there are.  */
+
+static unsigned int
+find_pattern_vars (const char *target, struct pattern_var ***vars)
+{
+  const unsigned int *nums;
+  size_t targlen = strlen (target);
+  unsigned int count;
+  unsigned int i, n;
+
+  *vars = 0;
+  if (pattern_vars == 0)
+    return 0;
+
+  if (!pattern_var_index_valid)
+    build_pattern_var_index ();
+
+  count = pattern_index_find (&pattern_var_index, target, targlen, 0, &nums);
+  if (count == 0)
+    return 0;
+
+  /* A suffix or prefix in common is not enough when the pattern has text
+     on both sides of its %.  */
+  *vars = xmalloc (count * sizeof (struct pattern_var *));
+  for (i = n = 0; i < count; ++i)
+    if (pattern_var_matches (pattern_var_vec[nums[i]], target, targlen))
+      (*vars)[n++] = pattern_var_vec[nums[i]];
+
+  if (n == 0)
+    {
+      free (*vars);
+      *vars = 0;
+    }
+
+  return n;
 }
 
 /* Hash table of all global variable definitions.  */
@@ -174,8 +255,14 @@ variable_hash_cmp (const void *xv, const void *yv)
 #ifndef SMALL_SCOPE_VARIABLE_BUCKETS
 #define SMALL_SCOPE_VARIABLE_BUCKETS    13
 #endif
+#ifndef SCOPE_FRAME_VARIABLES
+#define SCOPE_FRAME_VARIABLES           8
+#endif
 
 static struct variable_set global_variable_set;
+
+/* The set of variables of every file that has none of its own.  */
+static struct variable_set empty_file_set;
 static struct variable_set_list global_setlist
   = { 0, &global_variable_set, 0 };
 struct variable_set_list *current_variable_set_list = &global_setlist;
@@ -187,6 +274,88 @@ init_hash_global_variable_set (void)
 {
   hash_init (&global_variable_set.table, VARIABLE_BUCKETS,
              variable_hash_1, variable_hash_2, variable_hash_cmp);
+  hash_init (&empty_file_set.table, 1,
+             variable_hash_1, variable_hash_2, variable_hash_cmp);
+}
+
+/* The scopes of $(call), $(foreach) and $(let) hold a few variables at
+   most, as a rule, and are made and thrown away all the time.  So a scope
+   keeps its variables in a small array searched from the start, its frame,
+   and gets a hash table only if the frame fills up.  */
+
+struct scope_set
+  {
+    struct variable_set set;
+    struct variable *vars[SCOPE_FRAME_VARIABLES];
+  };
+
+/* Popped scopes, kept to be pushed again, linked through 'next'.  */
+static struct variable_set_list *free_scopes;
+
+/* Give SET, whose frame is full, a hash table with the variables in it.  */
+
+static void
+make_scope_table (struct variable_set *set)
+{
+  unsigned int i;
+
+  hash_init (&set->table, SMALL_SCOPE_VARIABLE_BUCKETS,
+             variable_hash_1, variable_hash_2, variable_hash_cmp);
+  for (i = 0; i < set->frame_count; ++i)
+    {
+      hash_insert (&set->table, set->frame[i]);
+      set->frame[i] = 0;
+    }
+  set->frame = 0;
+  set->frame_count = 0;
+}
+
+/* Find the variable named like KEY in SET, or return nil.  */
+
+static struct variable *
+find_variable_in_set (const struct variable_set *set,
+                      const struct variable *key)
+{
+  if (set->frame != 0)
+    {
+      struct variable **vp = set->frame;
+      struct variable **end = vp + set->frame_count;
+
+      for (; vp < end; ++vp)
+        if ((*vp)->length == key->length
+            && memcmp ((*vp)->name, key->name, key->length) == 0)
+          return *vp;
+
+      return 0;
+    }
+
+  return (struct variable *) hash_find_item ((struct hash_table *) &set->table,
+                                             key);
+}
+
+/* Return the slot for the variable named like KEY in SET: the one holding
+   it, or the one to put it in.  A full frame becomes a hash table.  */
+
+static struct variable **
+find_variable_slot (struct variable_set *set, const struct variable *key)
+{
+  if (set->frame != 0)
+    {
+      struct variable **vp = set->frame;
+      struct variable **end = vp + set->frame_count;
+
+      for (; vp < end; ++vp)
+        if ((*vp)->length == key->length
+            && memcmp ((*vp)->name, key->name, key->length) == 0)
+          return vp;
+
+      if (set->frame_count < SCOPE_FRAME_VARIABLES)
+        return end;
+
+      make_scope_table (set);
+    }
+
+  return (struct variable **) hash_find_slot (&set->table, key);
 }
 
 /* Define variable named NAME with value VALUE in SET.  VALUE is copied.
@@ -211,7 +380,7 @@ define_variable_in_set (const char *name, size_t length,
 
   var_key.name = (char *) name;
   var_key.length = length;
-  var_slot = (struct variable **) hash_find_slot (&set->table, &var_key);
+  var_slot = find_variable_slot (set, &var_key);
   v = *var_slot;
 
 #ifdef VMS
@@ -235,8 +404,7 @@ define_variable_in_set (const char *name, size_t length,
         {
           vms_variable =  lookup_variable(name, length);
           /* Refresh the slot */
-          var_slot = (struct variable **) hash_find_slot (&set->table,
-                                                          &var_key);
+          var_slot = find_variable_slot (set, &var_key);
           v = *var_slot;
         }
     }
@@ -259,6 +427,7 @@ define_variable_in_set (const char *name, size_t length,
         {
           free (v->value);
           v->value = xstrdup (value);
+          v->value_size = 0;
           if (flocp != 0)
             v->fileinfo = *flocp;
           else
@@ -274,7 +443,13 @@ define_variable_in_set (const char *name, size_t length,
   v = xcalloc (sizeof (struct variable));
   v->name = xstrndup (name, length);
   v->length = length;
-  hash_insert_at (&set->table, v, var_slot);
+  if (set->frame != 0)
+    {
+      *var_slot = v;
+      ++set->frame_count;
+    }
+  else
+    hash_insert_at (&set->table, v, var_slot);
   if (set == &global_variable_set)
     ++variable_changenum;
 
@@ -312,6 +487,34 @@ define_variable_in_set (const char *name, size_t length,
   return v;
 }
 
+/* Append VALUE, which is LENGTH bytes long, to the value of V after a space.
+   The buffer grows geometrically and its size is kept in V, so a makefile
+   adding to a variable in a long loop does not copy the whole value again
+   for each word it adds.  */
+
+static void
+append_variable_value (struct variable *v, const char *value, size_t length)
+{
+  size_t need;
+
+  if (v->value_size == 0)
+    v->value_length = strlen (v->value);
+
+  need = v->value_length + 1 + length + 1;
+  if (need > v->value_size)
+    {
+      size_t size = v->value_size * 2;
+      if (size < need)
+        size = need;
+      v->value = xrealloc (v->value, size);
+      v->value_size = size;
+    }
+
+  v->value[v->value_length] = ' ';
+  memcpy (&v->value[v->value_length + 1], value, length + 1);
+  v->value_length += 1 + length;
+}
+
 
 /* Undefine variable named NAME in SET. LENGTH is the length of NAME, which
    does not need to be null-terminated. ORIGIN specifies the origin of the
@@ -328,12 +531,92 @@ free_variable_name_and_value (const void *item)
 void
 free_variable_set (struct variable_set_list *list)
 {
-  hash_map (&list->set->table, free_variable_name_and_value);
-  hash_free (&list->set->table, 1);
-  free (list->set);
+  release_variable_set (list->set);
   free (list);
 }
 
+/* The variable sets of files may be shared.  Every file starts out with
+   EMPTY_FILE_SET, and files given the same target-specific variables
+   together share the set made for the first of them; see
+   record_target_var.  A shared set is copied before a file gets variables
+   of its own.  */
+
+/* Give up one use of SET, freeing it if that was the last.  */
+
+void
+release_variable_set (struct variable_set *set)
+{
+  if (set == &empty_file_set)
+    return;
+
+  if (set->shared != 0)
+    {
+      --set->shared;
+      return;
+    }
+
+  hash_map (&set->table, free_variable_name_and_value);
+  hash_free (&set->table, 1);
+  free (set);
+}
+
+/* Make LIST use SET, which it shares with the other users of SET.  */
+
+void
+share_variable_set (struct variable_set_list *list, struct variable_set *set)
+{
+  ++set->shared;
+  release_variable_set (list->set);
+  list->set = set;
+}
+
+/* Make the set of LIST its own, copying it if it is shared.  */
+
+void
+unshare_variable_set (struct variable_set_list *list)
+{
+  struct variable_set *from = list->set;
+  struct variable_set *set;
+  struct variable **slot;
+  struct variable **end;
+
+  if (from->shared == 0 && from != &empty_file_set)
+    return;
+
+  set = xmalloc (sizeof (struct variable_set));
+  hash_init (&set->table, PERFILE_VARIABLE_BUCKETS,
+             variable_hash_1, variable_hash_2, variable_hash_cmp);
+  set->shared = 0;
+  set->frame_count = 0;
+  set->frame = 0;
+
+  slot = (struct variable **) from->table.ht_vec;
+  end = slot + from->table.ht_size;
+  for (; slot < end; ++slot)
+    if (! HASH_VACANT (*slot))
+      {
+        struct variable *v = xmalloc (sizeof (struct variable));
+        *v = **slot;
+        v->name = xstrdup (v->name);
+        v->value = xstrdup (v->value);
+        v->value_size = 0;
+        hash_insert (&set->table, v);
+      }
+
+  list->set = set;
+  release_variable_set (from);
+}
+
+struct variable *
+define_variable_for_file (const char *name, size_t length, const char *value,
+                          enum variable_origin origin, int recursive,
+                          struct file *file)
+{
+  unshare_variable_set (file->variables);
+  return define_variable_in_set (name, length, value, origin, recursive,
+                                 file->variables->set, NILF);
+}
+
 void
 undefine_variable_in_set (const char *name, size_t length,
                           enum variable_origin origin,
@@ -348,7 +631,7 @@ undefine_variable_in_set (const char *name, size_t length,
 
   var_key.name = (char *) name;
   var_key.length = length;
-  var_slot = (struct variable **) hash_find_slot (&set->table, &var_key);
+  var_slot = find_variable_slot (set, &var_key);
 
   if (env_overrides && origin == o_env)
     origin = o_env_override;
@@ -365,7 +648,13 @@ undefine_variable_in_set (const char *name, size_t length,
          source than the variable definition.  */
       if ((int) origin >= (int) v->origin)
         {
-          hash_delete_at (&set->table, var_slot);
+          if (set->frame != 0)
+            {
+              *var_slot = set->frame[--set->frame_count];
+              set->frame[set->frame_count] = 0;
+            }
+          else
+            hash_delete_at (&set->table, var_slot);
           free_variable_name_and_value (v);
           free (v);
           if (set == &global_variable_set)
@@ -476,7 +765,7 @@ lookup_variable (const char *name, size_t length)
       const struct variable_set *set = setlist->set;
       struct variable *v;
 
-      v = (struct variable *) hash_find_item ((struct hash_table *) &set->table, &var_key);
+      v = find_variable_in_set (set, &var_key);
       if (v && (!is_parent || !v->private_var))
         return v->special ? lookup_special_var (v) : v;
 
@@ -557,7 +846,7 @@ lookup_variable_in_set (const char *name, size_t length,
   var_key.name = (char *) name;
   var_key.length = length;
 
-  return (struct variable *) hash_find_item ((struct hash_table *) &set->table, &var_key);
+  return find_variable_in_set (set, &var_key);
 }
 
 /* Initialize FILE's variable set list.  If FILE already has a variable set
@@ -578,9 +867,7 @@ initialize_file_variables (struct file *file, int reading)
     {
       l = (struct variable_set_list *)
         xmalloc (sizeof (struct variable_set_list));
-      l->set = xmalloc (sizeof (struct variable_set));
-      hash_init (&l->set->table, PERFILE_VARIABLE_BUCKETS,
-                 variable_hash_1, variable_hash_2, variable_hash_cmp);
+      l->set = &empty_file_set;
       file->variables = l;
     }
 
@@ -610,11 +897,12 @@ initialize_file_variables (struct file *file, int reading)
 
   if (!reading && !file->pat_searched)
     {
-      struct pattern_var *p;
+      struct pattern_var **pv;
+      unsigned int n = find_pattern_vars (file->name, &pv);
 
-      p = lookup_pattern_var (0, file->name);
-      if (p != 0)
+      if (n != 0)
         {
+          unsigned int i;
           struct variable_set_list *global = current_variable_set_list;
 
           /* We found at least one.  Set up a new variable set to accumulate
@@ -623,10 +911,11 @@ initialize_file_variables (struct file *file, int reading)
           file->pat_variables = create_new_variable_set ();
           current_variable_set_list = file->pat_variables;
 
-          do
+          for (i = 0; i < n; ++i)
             {
               /* We found one, so insert it into the set.  */
 
+              struct pattern_var *p = pv[i];
               struct variable *v;
 
               if (p->variable.flavor == f_simple)
@@ -651,9 +940,9 @@ initialize_file_variables (struct file *file, int reading)
               v->export = p->variable.export;
               v->private_var = p->variable.private_var;
             }
-          while ((p = lookup_pattern_var (p, file->name)) != 0);
 
           current_variable_set_list = global;
+          free (pv);
         }
       file->pat_searched = 1;
     }
@@ -681,6 +970,9 @@ create_new_variable_set (void)
   set = xmalloc (sizeof (struct variable_set));
   hash_init (&set->table, SMALL_SCOPE_VARIABLE_BUCKETS,
              variable_hash_1, variable_hash_2, variable_hash_cmp);
+  set->shared = 0;
+  set->frame_count = 0;
+  set->frame = 0;
 
   setlist = (struct variable_set_list *)
     xmalloc (sizeof (struct variable_set_list));
@@ -700,7 +992,21 @@ create_new_variable_set (void)
 struct variable_set_list *
 push_new_variable_scope (void)
 {
-  current_variable_set_list = create_new_variable_set ();
+  struct variable_set_list *setlist = free_scopes;
+
+  if (setlist != 0)
+    free_scopes = setlist->next;
+  else
+    {
+      struct scope_set *scope = xcalloc (sizeof (struct scope_set));
+      scope->set.frame = scope->vars;
+      setlist = xmalloc (sizeof (struct variable_set_list));
+      setlist->set = &scope->set;
+    }
+  setlist->next = current_variable_set_list;
+  setlist->next_is_parent = 0;
+
+  current_variable_set_list = setlist;
   if (current_variable_set_list->next == &global_setlist)
     {
       /* It was the global, so instead of new -> &global we want to replace
@@ -744,11 +1050,29 @@ pop_variable_scope (void)
       global_setlist.next_is_parent = setlist->next_is_parent;
     }
 
-  /* Free the one we no longer need.  */
-  free (setlist);
-  hash_map (&set->table, free_variable_name_and_value);
-  hash_free (&set->table, 1);
-  free (set);
+  /* Free its variables, and keep it to be pushed again.  */
+  if (set->frame != 0)
+    {
+      unsigned int i;
+
+      for (i = 0; i < set->frame_count; ++i)
+        {
+          free_variable_name_and_value (set->frame[i]);
+          free (set->frame[i]);
+          set->frame[i] = 0;
+        }
+    }
+  else
+    {
+      hash_map (&set->table, free_variable_name_and_value);
+      hash_free (&set->table, 1);
+      set->frame = ((struct scope_set *) set)->vars;
+    }
+  set->frame_count = 0;
+
+  setlist->set = set;
+  setlist->next = free_scopes;
+  free_scopes = setlist;
 }
 
 /* Merge FROM_SET into TO_SET, freeing unused storage in FROM_SET.  */
@@ -814,6 +1138,9 @@ merge_variable_set_lists (struct variable_set_list **setlist0,
           struct variable_set_list *from = setlist1;
           setlist1 = setlist1->next;
 
+          /* The variables of FROM are moved to TO: neither may be shared.  */
+          unshare_variable_set (to);
+          unshare_variable_set (from);
           merge_variable_sets (to->set, from->set);
 
           last0 = to;
@@ -893,6 +1220,7 @@ define_automatic_variables (void)
           /* overwrite whatever we got from the environment */
           free (shell->value);
           shell->value = xstrdup (default_shell);
+          shell->value_size = 0;
           shell->origin = o_default;
         }
 
@@ -941,6 +1269,7 @@ define_automatic_variables (void)
       free (v->value);
       v->origin = o_file;
       v->value = xstrdup (default_shell);
+      v->value_size = 0;
     }
 #endif
 
@@ -1031,8 +1360,16 @@ target_environment (struct file *file, int recursive)
   for (s = set_list; s != 0; s = s->next)
     {
       struct variable_set *set = s->set;
-      v_slot = (struct variable **) set->table.ht_vec;
-      v_end = v_slot + set->table.ht_size;
+      if (set->frame != 0)
+        {
+          v_slot = set->frame;
+          v_end = v_slot + set->frame_count;
+        }
+      else
+        {
+          v_slot = (struct variable **) set->table.ht_vec;
+          v_end = v_slot + set->table.ht_size;
+        }
       for ( ; v_slot < v_end; v_slot++)
         if (! HASH_VACANT (*v_slot))
           {
@@ -1143,6 +1480,7 @@ target_environment (struct file *file, int recursive)
                   {
                     free (v->value);
                     v->value = tmp;
+                    v->value_size = 0;
                   }
               }
 #endif
@@ -1207,6 +1545,7 @@ do_variable_definition (const floc *flocp, const char *varname,
   struct variable *v;
   int append = 0;
   int conditional = 0;
+  int in_place = 0;
 
   /* Calculate the variable's new value in VALUE.  */
 
@@ -1295,14 +1634,36 @@ do_variable_definition (const floc *flocp, const char *varname,
                  buffer if we're looking at a target-specific variable.  */
               val = tp = allocated_variable_expand (val);
 
-            oldlen = strlen (v->value);
             vallen = strlen (val);
-            p = alloc_value = xmalloc (oldlen + 1 + vallen + 1);
-            memcpy (alloc_value, v->value, oldlen);
-            alloc_value[oldlen] = ' ';
-            memcpy (&alloc_value[oldlen + 1], val, vallen + 1);
 
-            free (tp);
+            /* If V is the variable being defined, and would be redefined,
+               add to its value where it is.  */
+            if (!v->special
+                && (int) origin >= (int) v->origin
+                && !(env_overrides
+                     && (origin == o_env || v->origin == o_env))
+#if defined(__MSDOS__) || defined(WINDOWS32)
+                && !streq (varname, "SHELL")
+#endif
+                && (target_var
+                    || v == lookup_variable_in_set (varname, strlen (varname),
+                                                    &global_variable_set)))
+              {
+                append_variable_value (v, val, vallen);
+                in_place = 1;
+                p = v->value;
+                alloc_value = tp;
+              }
+            else
+              {
+                oldlen = strlen (v->value);
+                p = alloc_value = xmalloc (oldlen + 1 + vallen + 1);
+                memcpy (alloc_value, v->value, oldlen);
+                alloc_value[oldlen] = ' ';
+                memcpy (&alloc_value[oldlen + 1], val, vallen + 1);
+
+                free (tp);
+              }
           }
       }
     }
@@ -1388,6 +1749,17 @@ do_variable_definition (const floc *flocp, const char *varname,
     }
   else
 #endif /* __MSDOS__ */
+  if (in_place)
+    {
+      /* The new text was added to the value of V above.  */
+      if (flocp != 0)
+        v->fileinfo = *flocp;
+      else
+        v->fileinfo.filenm = 0;
+      v->origin = origin;
+      v->recursive = flavor == f_recursive;
+    }
+  else
 #ifdef WINDOWS32
   if ((origin == o_file || origin == o_override || origin == o_command)
       && streq (varname, "SHELL"))
@@ -63,6 +63,9 @@ struct variable
     char *value;                /* Variable value.  */
     floc fileinfo;              /* Where the variable was defined.  */
     unsigned int length;        /* strlen (name) */
+    size_t value_length;        /* strlen (value), if value_size is set */
+    size_t value_size;          /* Bytes allocated for value, or 0 if not
+                                   known; see append_variable_value.  */
     unsigned int recursive:1;   /* Gets recursively re-evaluated.  */
     unsigned int append:1;      /* Nonzero if an appending target-specific variable.  */
     unsigned int conditional:1; /* Nonzero if set with a ?=. */
@@ -87,6 +90,11 @@ struct variable
 struct variable_set
   {
     struct hash_table table;    /* Hash table of variables.  */
+    unsigned int shared;        /* Number of users besides the first.  */
+    unsigned int frame_count;   /* Number of variables in FRAME.  */
+    struct variable **frame;    /* If not null, the variables of a scope,
+                                   kept here instead of in TABLE; see
+                                   push_new_variable_scope.  */
   };
 
 /* Structure that represents a list of variable sets.  */
@@ -139,6 +147,8 @@ char *patsubst_expand_pat (char *o, const char *text, const char *pattern,
 char *patsubst_expand (char *o, const char *text, char *pattern, char *replace);
 char *func_shell_base (char *o, char **argv, int trim_newlines);
 void shell_completed (int exit_code, int exit_sig);
+extern int no_side_effects;
+extern unsigned int side_effects_skipped;
 
 /* expand.c */
 char *recursively_expand_for_file (struct variable *v, struct file *file);
@@ -147,6 +157,10 @@ char *recursively_expand_for_file (struct variable *v, struct file *file);
 /* variable.c */
 struct variable_set_list *create_new_variable_set (void);
 void free_variable_set (struct variable_set_list *);
+void share_variable_set (struct variable_set_list *list,
+                         struct variable_set *set);
+void unshare_variable_set (struct variable_set_list *list);
+void release_variable_set (struct variable_set *set);
 struct variable_set_list *push_new_variable_scope (void);
 void pop_variable_scope (void);
 void define_automatic_variables (void);
@@ -205,10 +219,12 @@ struct variable *define_variable_in_set (const char *name, size_t length,
 #define define_variable_global(n,l,v,o,r,f) \
           define_variable_in_set((n),(l),(v),(o),(r),NULL,(f))
 
-/* Define a variable in FILE's variable set.  */
+/* Define a variable in FILE's variable set, making that set FILE's own.  */
 
-#define define_variable_for_file(n,l,v,o,r,f) \
-          define_variable_in_set((n),(l),(v),(o),(r),(f)->variables->set,NILF)
+struct variable *define_variable_for_file (const char *name, size_t length,
+                                           const char *value,
+                                           enum variable_origin origin,
+                                           int recursive, struct file *file);
 
 void undefine_variable_in_set (const char *name, size_t length,
                                enum variable_origin origin,
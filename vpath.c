@@ -36,6 +36,7 @@ struct vpath
     const char **searchpath; /* Null-terminated list of directories.  */
     unsigned int maxlen;/* Maximum length of any entry in the list.  */
     int target_goal;    /* If non-zero, non-existent (target) files are located in the first directory in the vpath. */
+    unsigned int *searchnum; /* Numbers of the directories in the index.  */
   };
 
 /* Linked-list of all selective VPATHs.  */
@@ -50,6 +51,20 @@ static struct vpath *general_vpath;
 
 static struct vpath *gpaths;
 
+#if !defined(VMS) && !defined(WINDOWS32) && !defined(HAVE_DOS_PATHS) \
+    && !defined(HAVE_CASE_INSENSITIVE_FS)
+# define SEARCH_INDEX 1
+#endif
+
+#ifdef SEARCH_INDEX
+static void invalidate_search_index (void);
+#else
+# define invalidate_search_index()
+#endif
+
+/* Bumped whenever the search paths change.  */
+unsigned long vpath_generation = 0;
+
 
 /* Reverse the chain of selective VPATH lists so they will be searched in the
    order given in the makefiles and construct the list from the VPATH
@@ -62,6 +77,9 @@ build_vpath_lists (void)
   struct vpath *old, *nexto;
   char *p;
 
+  invalidate_search_index ();
+  ++vpath_generation;
+
   /* Reverse the chain.  */
   for (old = vpaths; old != 0; old = nexto)
     {
@@ -172,6 +190,9 @@ construct_vpath_list (char *pattern, char *dirpath, int is_target_path)
   if (pattern != 0)
     percent = find_percent (pattern);
 
+  invalidate_search_index ();
+  ++vpath_generation;
+
   if (!dirpath)
     {
       /* Remove matching listings.  */
@@ -198,6 +219,7 @@ construct_vpath_list (char *pattern, char *dirpath, int is_target_path)
               /* Free its unused storage.  */
               /* MSVC erroneously warns without a cast here.  */
               free ((void *)path->searchpath);
+              free (path->searchnum);
               free (path);
             }
           else
@@ -309,6 +331,7 @@ construct_vpath_list (char *pattern, char *dirpath, int is_target_path)
       /* Construct the vpath structure and put it into the linked list.  */
       path = xmalloc (sizeof (struct vpath));
       path->searchpath = vpath;
+      path->searchnum = 0;
       path->maxlen = maxvpath;
       path->target_goal = is_target_path;
       path->next = vpaths;
@@ -329,17 +352,349 @@ construct_vpath_list (char *pattern, char *dirpath, int is_target_path)
 #endif
 }
 
+#ifdef SEARCH_INDEX
+
+/* The search index tells, for a name without a directory part, which of
+   the directories on the search paths may have a file of that name: those
+   whose contents, as read into dir.c's cache, include it, and those in
+   which the makefiles mention a file of that name.  Looking a name up
+   along a long VPATH then takes one probe of the index, and only the
+   directories it names are looked at in full.  The index is built when it
+   is first needed and thrown away when the search paths change.
+
+   Every directory on a search path has a number; each name in the index
+   has a bit set of those numbers.  Directories are entered under the name
+   lookup_file() sees, without any leading "./".  The GPATH directories are
+   entered too, under their names as given, so that gpath_search() takes a
+   single probe as well.  */
+
+struct search_dir
+  {
+    const char *name;           /* The name of the directory.  */
+    unsigned int len;
+    const char *path;           /* Its name on the search path.  */
+    unsigned int num;           /* Its number, if SEARCHED.  */
+    unsigned int searched:1;    /* Nonzero if on a search path.  */
+    unsigned int listed:1;      /* Nonzero if its files are in the index.  */
+    unsigned int gpath:1;       /* Nonzero if in GPATH.  */
+  };
+
+struct search_name
+  {
+    const char *name;           /* A file name, without a directory.  */
+    unsigned long dirs[1];      /* Bits for the directories it may be in.  */
+  };
+
+#define SEARCH_WORD_BITS (sizeof (unsigned long) * CHAR_BIT)
+
+static struct hash_table search_dirs;
+static struct hash_table search_names;
+static struct search_dir **search_dir_vec;
+static unsigned int search_dir_count;
+static unsigned int search_words;
+
+/* Nonzero if the index is up to date, and the value of dir_generation it
+   was built with.  */
+static int search_index_valid = 0;
+static unsigned long search_generation;
+
+static unsigned long
+search_dir_hash_1 (const void *key)
+{
+  const struct search_dir *sd = key;
+  return_STRING_N_HASH_1 (sd->name, sd->len);
+}
+
+static unsigned long
+search_dir_hash_2 (const void *key)
+{
+  const struct search_dir *sd = key;
+  return_STRING_N_HASH_2 (sd->name, sd->len);
+}
+
+static int
+search_dir_hash_cmp (const void *x, const void *y)
+{
+  const struct search_dir *a = x;
+  const struct search_dir *b = y;
+  int r = a->len - b->len;
+  if (r)
+    return r;
+  return_STRING_N_COMPARE (a->name, b->name, a->len);
+}
+
+static unsigned long
+search_name_hash_1 (const void *key)
+{
+  return_STRING_HASH_1 (((const struct search_name *) key)->name);
+}
+
+static unsigned long
+search_name_hash_2 (const void *key)
+{
+  return_STRING_HASH_2 (((const struct search_name *) key)->name);
+}
+
+static int
+search_name_hash_cmp (const void *x, const void *y)
+{
+  return_STRING_COMPARE (((const struct search_name *) x)->name,
+                         ((const struct search_name *) y)->name);
+}
+
+static void
+invalidate_search_index (void)
+{
+  if (!search_index_valid)
+    return;
+
+  hash_free (&search_dirs, 1);
+  hash_free (&search_names, 1);
+  free (search_dir_vec);
+  search_dir_vec = 0;
+  search_index_valid = 0;
+}
+
+/* Find the directory NAME, LEN bytes long, entering it if CREATE.  */
+
+static struct search_dir *
+find_search_dir (const char *name, unsigned int len, int create)
+{
+  struct search_dir key;
+  struct search_dir **slot;
+  struct search_dir *sd;
+
+  key.name = name;
+  key.len = len;
+  slot = (struct search_dir **) hash_find_slot (&search_dirs, &key);
+  sd = *slot;
+  if (HASH_VACANT (sd) && create)
+    {
+      sd = xcalloc (sizeof (struct search_dir));
+      sd->name = strcache_add_len (name, len);
+      sd->len = len;
+      hash_insert_at (&search_dirs, sd, slot);
+    }
+  return HASH_VACANT (sd) ? 0 : sd;
+}
+
+/* Give the directories of search path V their numbers.  */
+
+static void
+number_search_dirs (struct vpath *v)
+{
+  unsigned int i, n;
+
+  for (n = 0; v->searchpath[n] != 0; ++n)
+    ;
+  free (v->searchnum);
+  v->searchnum = xmalloc (n * sizeof (unsigned int));
+
+  for (i = 0; i < n; ++i)
+    {
+      const char *name = v->searchpath[i];
+      struct search_dir *sd;
+
+      /* Strip the "./" that lookup_file() would.  */
+      while (name[0] == '.' && name[1] == '/' && name[2] != '\0')
+        {
+          name += 2;
+          while (*name == '/')
+            ++name;
+        }
+
+      sd = find_search_dir (name, strlen (name), 1);
+      if (!sd->searched)
+        {
+          sd->searched = 1;
+          sd->path = v->searchpath[i];
+          sd->num = search_dir_count++;
+        }
+      v->searchnum[i] = sd->num;
+    }
+}
+
+/* Note that NAME may be in the directory numbered NUM.  */
+
+static void
+add_search_name (const char *name, unsigned int num)
+{
+  struct search_name key;
+  struct search_name **slot;
+  struct search_name *sn;
+
+  key.name = name;
+  slot = (struct search_name **) hash_find_slot (&search_names, &key);
+  sn = *slot;
+  if (HASH_VACANT (sn))
+    {
+      sn = xcalloc (sizeof (struct search_name)
+                    + (search_words - 1) * sizeof (unsigned long));
+      sn->name = strcache_add (name);
+      hash_insert_at (&search_names, sn, slot);
+    }
+  sn->dirs[num / SEARCH_WORD_BITS] |= 1UL << (num % SEARCH_WORD_BITS);
+}
+
+static void
+add_listed_name (const char *name, void *arg)
+{
+  add_search_name (name, ((struct search_dir *) arg)->num);
+}
+
+/* Enter file NAME, which the makefiles mention, in the index if its
+   directory is on a search path.  */
+
+static void
+add_file_name (const char *name)
+{
+  const char *slash = strrchr (name, '/');
+  struct search_dir *sd;
+
+  if (slash == 0 || slash[1] == '\0')
+    return;
+
+  sd = find_search_dir (name, slash == name ? 1 : slash - name, 0);
+  if (sd != 0 && sd->searched)
+    add_search_name (slash + 1, sd->num);
+}
+
+static void
+add_file (const void *item)
+{
+  add_file_name (((const struct file *) item)->hname);
+}
+
+/* Build the index afresh.  */
+
+static void
+build_search_index (void)
+{
+  struct vpath *v;
+  unsigned int i;
+
+  invalidate_search_index ();
+
+  hash_init (&search_dirs, 61, search_dir_hash_1, search_dir_hash_2,
+             search_dir_hash_cmp);
+  search_dir_count = 0;
+  for (v = vpaths; v != 0; v = v->next)
+    number_search_dirs (v);
+  if (general_vpath != 0)
+    number_search_dirs (general_vpath);
+  if (gpaths != 0)
+    for (i = 0; gpaths->searchpath[i] != 0; ++i)
+      find_search_dir (gpaths->searchpath[i],
+                       strcache_get_len (gpaths->searchpath[i]), 1)->gpath = 1;
+
+  search_words = (search_dir_count + SEARCH_WORD_BITS - 1) / SEARCH_WORD_BITS;
+  if (search_words == 0)
+    search_words = 1;
+  hash_init (&search_names, 8191, search_name_hash_1, search_name_hash_2,
+             search_name_hash_cmp);
+
+  /* Number the directories in order, and read them in.  */
+  search_dir_vec = xcalloc ((search_dir_count + 1)
+                            * sizeof (struct search_dir *));
+  {
+    struct search_dir **slot = (struct search_dir **) search_dirs.ht_vec;
+    struct search_dir **end = slot + search_dirs.ht_size;
+
+    for (; slot < end; ++slot)
+      if (! HASH_VACANT (*slot) && (*slot)->searched)
+        search_dir_vec[(*slot)->num] = *slot;
+  }
+  search_generation = dir_generation;
+  for (i = 0; i < search_dir_count; ++i)
+    search_dir_vec[i]->listed = dir_map_files (search_dir_vec[i]->path,
+                                               add_listed_name,
+                                               search_dir_vec[i]);
+
+  /* Reading the directories may have changed dir_generation.  */
+  search_generation = dir_generation;
+  search_index_valid = 1;
+  map_files (add_file);
+
+  DB (DB_VERBOSE, (_("Indexed %lu names in %u search directories.\n"),
+                   search_names.ht_fill, search_dir_count));
+}
+
+/* Make sure the index is up to date.  Return nonzero if it can be used.  */
+
+static int
+search_index_ready (void)
+{
+  if (vpaths == 0 && general_vpath == 0 && gpaths == 0)
+    return 0;
+  if (!search_index_valid || search_generation != dir_generation)
+    build_search_index ();
+  return 1;
+}
+
+/* Return the bits of the directories that NAME may be in, or null if it
+   is in none of them.  */
+
+static const unsigned long *
+find_search_name (const char *name)
+{
+  struct search_name key;
+  struct search_name *sn;
+
+  key.name = name;
+  sn = hash_find_item (&search_names, &key);
+  return sn != 0 ? sn->dirs : 0;
+}
+
+/* Return nonzero if the directory numbered NUM may have a file whose bits
+   are DIRS.  */
+
+static int
+search_dir_maybe (const unsigned long *dirs, unsigned int num)
+{
+  if (!search_dir_vec[num]->listed)
+    return 1;
+  return (dirs != 0
+          && (dirs[num / SEARCH_WORD_BITS]
+              & (1UL << (num % SEARCH_WORD_BITS))) != 0);
+}
+
+/* FILE has just been entered in the data base, or renamed.  */
+
+void
+vpath_note_file (const char *name)
+{
+  if (search_index_valid)
+    add_file_name (name);
+}
+
+#else /* !SEARCH_INDEX */
+
+void
+vpath_note_file (const char *name UNUSED)
+{
+}
+
+#endif /* SEARCH_INDEX */
+
 /* Search the GPATH list for a pathname string that matches the one passed
    in.  If it is found, return 1.  Otherwise we return 0.  */
 
 int
 gpath_search (const char *file, unsigned int len)
 {
+#ifdef SEARCH_INDEX
+  if (gpaths && (len <= gpaths->maxlen) && search_index_ready ())
+    {
+      struct search_dir *sd = find_search_dir (file, len, 0);
+      return sd != 0 && sd->gpath;
+    }
+#endif
+
   if (gpaths && (len <= gpaths->maxlen))
     {
       const char **gp;
       for (gp = gpaths->searchpath; *gp != NULL; ++gp)
-        if (strneq (*gp, file, len) && (*gp)[len] == '\0')
+        if (strcache_get_len (*gp) == len && memcmp (*gp, file, len) == 0)
           return 1;
     }
 
@@ -358,7 +713,7 @@ static int vpath_match(const struct vpath *vpath, const char *filename)
 
   /* If the pattern ends with a '.' and the file has no extension (it does
      not have a '.'), also match without the dot in the pattern. */
-  length = strlen (vpath->pattern);
+  length = vpath->patlen;
   assert(length > 0);
   if (vpath->pattern[length - 1] == '.' && strchr (filename, '.') == NULL)
     {
@@ -394,6 +749,10 @@ selective_vpath_search (struct vpath *path, const char *file,
   int exists = 0;
   char *tgt_name = NULL;
   size_t tgt_len = 0;
+#ifdef SEARCH_INDEX
+  const unsigned long *dirs = 0;
+  int indexed = 0;
+#endif
 
   /* Find out if *FILE is a target.
      If and only if it is NOT a target, we will accept prospective
@@ -428,12 +787,30 @@ selective_vpath_search (struct vpath *path, const char *file,
      always be necessary), the filename, and a null terminator.  */
   name = alloca (maxvpath + 1 + name_dplen + 1 + flen + 1);
 
+#ifdef SEARCH_INDEX
+  /* The index knows about names without a directory part.  */
+  if (name_dplen == 0 && search_index_ready ())
+    {
+      indexed = 1;
+      dirs = find_search_name (filename);
+    }
+#endif
+
   /* Try each VPATH entry.  */
   for (i = 0; vpath[i] != 0; ++i)
     {
       int exists_in_cache = 0;
       char *p = name;
-      unsigned int vlen = strlen (vpath[i]);
+      unsigned int vlen = strcache_get_len (vpath[i]);
+
+#ifdef SEARCH_INDEX
+      /* Skip the directories that neither have the file nor are said to
+         in the makefiles.  The first directory of a target path is used
+         even then.  */
+      if (indexed && !(is_target_path && i == 0)
+          && !search_dir_maybe (dirs, path->searchnum[i]))
+        continue;
+#endif
 
       /* Put the next VPATH entry into NAME at P and increment P past it.  */
       memcpy (p, vpath[i], vlen);
@@ -561,7 +938,7 @@ selective_vpath_search (struct vpath *path, const char *file,
               /* Get the file stat, and also check whether the file really
                  exists. If it does not exist, but this VPATH is set to be
                  a target path (and the file is a target), still proceed.  */
-              EINTRLOOP (e, stat (name, &st));
+              EINTRLOOP (e, dir_stat (name, &st));
               if (e != 0)
                 {
                   exists = 0;
@@ -621,6 +998,82 @@ selective_vpath_search (struct vpath *path, const char *file,
 }
 
 
+/* Return nonzero if V might lead selective_vpath_search to a file in
+   directory DIR, DIRLEN bytes long, whose name ends in the extension EXT.
+   The directories are put together the way it does.  */
+
+static int
+path_extension_p (const struct vpath *v, const char *dir, size_t dirlen,
+                  const char *ext)
+{
+  char *name;
+  unsigned int i;
+
+  /* A target path finds a name whether or not the file exists.  */
+  if (v->target_goal)
+    return 1;
+
+  name = alloca (v->maxlen + 1 + dirlen + 1);
+  for (i = 0; v->searchpath[i] != 0; ++i)
+    {
+      char *p = name;
+      unsigned int vlen = strcache_get_len (v->searchpath[i]);
+
+      memcpy (p, v->searchpath[i], vlen);
+      p += vlen;
+      if (dirlen > 0)
+        {
+          *p++ = '/';
+          memcpy (p, dir, dirlen - 1);
+          p += dirlen - 1;
+        }
+      *p = '\0';
+      if (dir_extension_p (name, ext))
+        return 1;
+
+      if (p != name && p[-1] != '/')
+        *p++ = '/';
+      if (file_extension_p (name, p - name, ext))
+        return 1;
+    }
+
+  return 0;
+}
+
+/* Return nonzero if vpath_search might find a file in directory DIR, DIRLEN
+   bytes long and ending in a slash unless it is empty, whose name ends in
+   the extension EXT: the text from its last '.', or "" if it has none.
+   Every search path is considered, whatever its pattern.  */
+
+int
+vpath_extension_p (const char *dir, size_t dirlen, const char *ext)
+{
+  struct vpath *v;
+
+  if (dir[0] == '/'
+#ifdef HAVE_DOS_PATHS
+      || dir[0] == '\\' || (dirlen > 1 && dir[1] == ':')
+#endif
+      )
+    return 0;
+
+  for (v = vpaths; v != 0; v = v->next)
+    if (path_extension_p (v, dir, dirlen, ext))
+      return 1;
+
+  return general_vpath != 0 && path_extension_p (general_vpath, dir, dirlen,
+                                                 ext);
+}
+
+/* Return nonzero if there are search paths for vpath_search() to look
+   along.  */
+
+int
+vpath_defined_p (void)
+{
+  return vpaths != 0 || general_vpath != 0;
+}
+
 /* Search the VPATH list whose pattern matches FILE for a directory where FILE
    exists.  If it is found, return the cached name of an existing file, and
    set *MTIME_PTR (if MTIME_PTR is not NULL) to its modtime (or zero if no